@@ -2,631 +2,6143 @@
 #include <string>
 #include <vector>
 #include <queue>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cmath>
 #include <GL/glut.h>
-#include <regex>
+#include <string_view>
+#include <cstdint>
+#include <memory>
+#include <charconv>
+#include <type_traits>
 #include <unordered_map>
+#include <map>
+#include <tuple>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <random>
+#include <array>
+#include <cstdlib>
+#include <list>
 
+// Nucleos SIMD de x86 (SSE siempre, AVX2 elegido al ejecutar), en otras plataformas solo la version escalar
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define USAR_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define USAR_SIMD_X86 0
+#endif
+
+// Lectura de archivos por mapeo en memoria en sistemas POSIX, en otros se lee por trozos
+#if defined(__unix__) || defined(__APPLE__)
+#define USAR_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define USAR_MMAP 0
+#endif
+
+// Salida con write directo sobre el descriptor en sistemas POSIX, en otros por cout y cerr
+#if defined(__unix__) || defined(__APPLE__)
+#define USAR_WRITE 1
+#include <unistd.h>
+#include <cerrno>
+#else
+#define USAR_WRITE 0
+#endif
+
+// Modo servidor en un socket Unix y benchmark contra un proceso por expresion, solo en POSIX
+#if defined(__unix__) || defined(__APPLE__)
+#define USAR_SOCKETS 1
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <csignal>
+#include <cerrno>
+#else
+#define USAR_SOCKETS 0
+#endif
+
+// Codigo nativo: el lenguaje intermedio se traduce a C, se compila con el compilador del sistema y se carga con dlopen
+#if defined(__unix__) || defined(__APPLE__)
+#define USAR_NATIVO 1
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#else
+#define USAR_NATIVO 0
+#endif
+
+// Tamaño real de cada bloque de malloc para medir la memoria viva con --stats
+#if defined(__GLIBC__)
+#define USAR_TAMANO_MALLOC 1
+#include <malloc.h>
+#else
+#define USAR_TAMANO_MALLOC 0
+#endif
+
+#ifndef M_PI
 #define M_PI 3.14159265358979323846 // Definición de PI para dibujar los circulos del arbol
+#endif
 
 using namespace std;
 
-// Estructura para los nodos del árbol ternario
+// Simbolos que pueden aparecer en el arbol de parseo, se comparan como enteros en lugar de cadenas
+enum class Simbolo : uint8_t {
+    E,
+    T,
+    U,
+    Suma,
+    Resta,
+    Multiplicacion,
+    Division,
+    AbreParentesis,
+    CierraParentesis,
+    Num,
+    Id,
+    Literal, // Valor de un num o nombre de un id, el texto se guarda aparte
+    Nulo
+};
+
+// Texto con el que se muestra cada simbolo en el arbol
+const char* nombreSimbolo(Simbolo simbolo) {
+    switch (simbolo) {
+    case Simbolo::E: return "<E>";
+    case Simbolo::T: return "<T>";
+    case Simbolo::U: return "<U>";
+    case Simbolo::Suma: return "+";
+    case Simbolo::Resta: return "-";
+    case Simbolo::Multiplicacion: return "*";
+    case Simbolo::Division: return "/";
+    case Simbolo::AbreParentesis: return "(";
+    case Simbolo::CierraParentesis: return ")";
+    case Simbolo::Num: return "num";
+    case Simbolo::Id: return "id";
+    case Simbolo::Literal: return "";
+    case Simbolo::Nulo: return "NULL";
+    }
+    return "";
+}
+
+bool esNoTerminal(Simbolo simbolo) {
+    return simbolo == Simbolo::E || simbolo == Simbolo::T || simbolo == Simbolo::U;
+}
+
+/* Estructura para los nodos del árbol ternario. El valor es una vista a un texto que vive mas que
+el arbol (los simbolos de la gramatica o el literal dentro de la entrada del contexto), asi el
+nodo no tiene destructor y la arena puede liberar el arbol entero sin recorrerlo */
 struct Nodo {
-    string valor;
+    Simbolo simbolo;
+    string_view valor;
     Nodo* izquierdo;
     Nodo* medio;
     Nodo* derecho;
     Nodo* padre;
 
     // Constructor del nodo
-    Nodo(const string& val) : valor(val), izquierdo(nullptr), medio(nullptr), derecho(nullptr), padre(nullptr) {}
+    Nodo(Simbolo sim, string_view val) : simbolo(sim), valor(val), izquierdo(nullptr), medio(nullptr), derecho(nullptr), padre(nullptr) {}
 };
+static_assert(is_trivially_destructible<Nodo>::value, "La arena no llama destructores de Nodo");
 
-// Contenedores globales para separar los tokens y valores numéricos
-vector<string> cadena;
-vector<string> valores;
-vector<Nodo*> ultimos;
-vector<string> operaciones;
+/* Asignador por bloques (bump allocator): reservar es avanzar un desplazamiento dentro del bloque
+actual y reiniciar regresa al primer bloque en O(1). Los bloques se conservan entre expresiones,
+por lo que la memoria se mantiene estable en ejecuciones largas */
+class Arena {
+public:
+    static constexpr size_t TAM_BLOQUE = 64 * 1024;
 
-// Prototipo de la funcion errores
-void errores(int);
+    void* reservar(size_t tam, size_t alineacion) {
+        size_t inicio = (usado + alineacion - 1) & ~(alineacion - 1);
+        if (bloques.empty() || inicio + tam > TAM_BLOQUE) {
+            // Pasa al siguiente bloque, solo se pide memoria nueva si no hay uno de una expresion anterior
+            if (!bloques.empty()) bloqueActual++;
+            if (bloqueActual == bloques.size()) {
+                bloques.emplace_back(new char[TAM_BLOQUE]);
+            }
+            inicio = 0;
+        }
+        usado = inicio + tam;
+        bytes += tam;
+        return bloques[bloqueActual].get() + inicio;
+    }
+
+    // Libera todo lo reservado sin devolver los bloques al sistema
+    void reiniciar() {
+        bloqueActual = 0;
+        usado = 0;
+        bytes = 0;
+    }
+
+    size_t bytesUsados() const { return bytes; }
+    size_t bytesReservados() const { return bloques.size() * TAM_BLOQUE; }
+
+private:
+    vector<unique_ptr<char[]>> bloques;
+    size_t bloqueActual = 0;
+    size_t usado = 0;
+    size_t bytes = 0;
+};
+
+// Tipos de token que produce el lexer
+enum class TipoToken : uint8_t {
+    Num,
+    Suma,
+    Resta,
+    Multiplicacion,
+    Division,
+    AbreParentesis,
+    CierraParentesis,
+    Id
+};
+
+// Token compacto: tipo y posicion del texto dentro de la entrada, sin copiar el lexema
+struct Token {
+    TipoToken tipo;
+    bool flotante;     // Solo para num: el literal lleva punto decimal
+    uint32_t inicio;
+    uint32_t longitud;
+};
+
+// Texto con el que se imprime cada tipo de token
+const char* nombreToken(TipoToken tipo) {
+    switch (tipo) {
+    case TipoToken::Num: return "num";
+    case TipoToken::Suma: return "+";
+    case TipoToken::Resta: return "-";
+    case TipoToken::Multiplicacion: return "*";
+    case TipoToken::Division: return "/";
+    case TipoToken::AbreParentesis: return "(";
+    case TipoToken::CierraParentesis: return ")";
+    case TipoToken::Id: return "id";
+    }
+    return "";
+}
+
+/* Escanea un literal numerico que empieza en 'inicio' con la forma [0-9]*\.?[0-9]+
+Regresa la posicion siguiente al literal; 'valido' es falso si tiene mas de un punto o termina en punto */
+size_t escanearNumero(string_view texto, size_t inicio, bool& flotante, bool& valido) {
+    size_t i = inicio;
+    int puntos = 0;
+    while (i < texto.size() && ((texto[i] >= '0' && texto[i] <= '9') || texto[i] == '.')) {
+        if (texto[i] == '.') puntos++;
+        i++;
+    }
+    flotante = puntos > 0;
+    valido = puntos <= 1 && texto[i - 1] != '.';
+    return i;
+}
 
-// Función para verificar si una cadena representa un número
-bool esNumero(const string& str) {
-    std::regex numero_regex("^[0-9]*\\.?[0-9]+$");
-    return regex_match(str, numero_regex);
+// Simbolo del arbol que corresponde a un token de operador o parentesis
+Simbolo simboloDeToken(TipoToken tipo) {
+    switch (tipo) {
+    case TipoToken::Num: return Simbolo::Num;
+    case TipoToken::Suma: return Simbolo::Suma;
+    case TipoToken::Resta: return Simbolo::Resta;
+    case TipoToken::Multiplicacion: return Simbolo::Multiplicacion;
+    case TipoToken::Division: return Simbolo::Division;
+    case TipoToken::AbreParentesis: return Simbolo::AbreParentesis;
+    case TipoToken::CierraParentesis: return Simbolo::CierraParentesis;
+    case TipoToken::Id: return Simbolo::Id;
+    }
+    return Simbolo::Nulo;
 }
 
+/* Disposicion ordenada del arbol (Reingold–Tilford, en la version lineal de Buchheim, Jünger
+y Leipert): cada subarbol se acomoda lo mas junto posible a su hermano izquierdo sin
+encimarse, el padre queda centrado sobre sus hijos y subarboles iguales se dibujan iguales.
+Se calcula una vez en O(n) con arreglos indexados en preorden y recorridos sin recursion; x se
+mide en separaciones entre nodos y y en niveles (la raiz en el nivel 0) */
+class DisposicionArbol {
+public:
+    static constexpr int32_t NINGUNO = -1;
+
+    vector<const Nodo*> nodos; // En preorden, nodos[0] es la raiz
+    vector<int32_t> padre;
+    vector<float> x;
+    vector<int32_t> nivel;
+
+    void calcular(const Nodo* raiz) {
+        indexar(raiz);
+        size_t n = nodos.size();
+        preliminar.assign(n, 0);
+        modificador.assign(n, 0);
+        cambio.assign(n, 0);
+        corrimiento.assign(n, 0);
+        hilo.assign(n, NINGUNO);
+        ancestro.resize(n);
+        ancestroPorOmision.assign(n, NINGUNO);
+        for (size_t v = 0; v < n; v++) ancestro[v] = int32_t(v);
+        if (n == 0) return;
+
+        // Primer recorrido en postorden (de izquierda a derecha): posiciones relativas al padre
+        for (int32_t v : postorden) {
+            int32_t p = padre[v];
+            if (cantidadHijos[v] == 0) {
+                preliminar[v] = numero[v] > 0 ? preliminar[hijos[p][numero[v] - 1]] + SEPARACION : 0;
+            }
+            else {
+                ejecutarCorrimientos(v);
+                int32_t primero = hijos[v][0], ultimo = hijos[v][cantidadHijos[v] - 1];
+                float medio = (preliminar[primero] + preliminar[ultimo]) / 2;
+                if (numero[v] > 0) {
+                    preliminar[v] = preliminar[hijos[p][numero[v] - 1]] + SEPARACION;
+                    modificador[v] = preliminar[v] - medio;
+                }
+                else {
+                    preliminar[v] = medio;
+                }
+            }
+            if (p != NINGUNO) {
+                if (ancestroPorOmision[p] == NINGUNO) ancestroPorOmision[p] = hijos[p][0];
+                ancestroPorOmision[p] = repartir(v, ancestroPorOmision[p]);
+            }
+        }
+
+        // Segundo recorrido en preorden: cada nodo suma los modificadores de sus ancestros
+        vector<float> acumulado(n, 0);
+        for (size_t v = 0; v < n; v++) {
+            int32_t p = padre[v];
+            if (p != NINGUNO) {
+                acumulado[v] = acumulado[p] + modificador[p];
+                nivel[v] = nivel[p] + 1;
+            }
+            x[v] = preliminar[v] + acumulado[v];
+        }
+        float minimo = *min_element(x.begin(), x.end());
+        for (float& valor : x) valor -= minimo;
+    }
+
+    float ancho() const {
+        return x.empty() ? 0 : *max_element(x.begin(), x.end());
+    }
+
+    int32_t profundidad() const {
+        return nivel.empty() ? 0 : *max_element(nivel.begin(), nivel.end());
+    }
+
+    const array<int32_t, 3>& hijosDe(size_t v) const { return hijos[v]; }
+    uint8_t cantidadHijosDe(size_t v) const { return cantidadHijos[v]; }
+
+private:
+    static constexpr float SEPARACION = 1.0f;
+
+    // Numera los nodos en preorden y arma el postorden de izquierda a derecha, con pilas explicitas
+    void indexar(const Nodo* raiz) {
+        nodos.clear();
+        padre.clear();
+        hijos.clear();
+        cantidadHijos.clear();
+        numero.clear();
+        postorden.clear();
+        vector<pair<const Nodo*, int32_t>> pila;
+        if (raiz) pila.push_back({ raiz, NINGUNO });
+        while (!pila.empty()) {
+            auto [nodo, p] = pila.back();
+            pila.pop_back();
+            int32_t v = int32_t(nodos.size());
+            nodos.push_back(nodo);
+            padre.push_back(p);
+            hijos.push_back({ NINGUNO, NINGUNO, NINGUNO });
+            cantidadHijos.push_back(0);
+            numero.push_back(0);
+            if (p != NINGUNO) {
+                numero[v] = cantidadHijos[p];
+                hijos[p][cantidadHijos[p]++] = v;
+            }
+            for (const Nodo* hijo : { nodo->derecho, nodo->medio, nodo->izquierdo }) {
+                if (hijo) pila.push_back({ hijo, v });
+            }
+        }
+        // El preorden que visita primero al hijo derecho, al reves, es el postorden buscado
+        pila.clear();
+        vector<int32_t> espejo;
+        vector<int32_t> pendientes;
+        if (!nodos.empty()) pendientes.push_back(0);
+        while (!pendientes.empty()) {
+            int32_t v = pendientes.back();
+            pendientes.pop_back();
+            espejo.push_back(v);
+            for (uint8_t i = 0; i < cantidadHijos[v]; i++) pendientes.push_back(hijos[v][i]);
+        }
+        postorden.assign(espejo.rbegin(), espejo.rend());
+        x.assign(nodos.size(), 0);
+        nivel.assign(nodos.size(), 0);
+    }
+
+    int32_t siguienteIzquierdo(int32_t v) const {
+        return cantidadHijos[v] ? hijos[v][0] : hilo[v];
+    }
+
+    int32_t siguienteDerecho(int32_t v) const {
+        return cantidadHijos[v] ? hijos[v][cantidadHijos[v] - 1] : hilo[v];
+    }
+
+    // Junta el subarbol de 'v' con los de sus hermanos izquierdos recorriendo los contornos
+    int32_t repartir(int32_t v, int32_t porOmision) {
+        int32_t p = padre[v];
+        if (numero[v] == 0) return porOmision;
+        int32_t internoDerecho = v, externoDerecho = v;
+        int32_t internoIzquierdo = hijos[p][numero[v] - 1];
+        int32_t externoIzquierdo = hijos[p][0];
+        float sumaInternoDerecho = modificador[internoDerecho], sumaExternoDerecho = modificador[externoDerecho];
+        float sumaInternoIzquierdo = modificador[internoIzquierdo], sumaExternoIzquierdo = modificador[externoIzquierdo];
+
+        while (siguienteDerecho(internoIzquierdo) != NINGUNO && siguienteIzquierdo(internoDerecho) != NINGUNO) {
+            internoIzquierdo = siguienteDerecho(internoIzquierdo);
+            internoDerecho = siguienteIzquierdo(internoDerecho);
+            externoIzquierdo = siguienteIzquierdo(externoIzquierdo);
+            externoDerecho = siguienteDerecho(externoDerecho);
+            ancestro[externoDerecho] = v;
+            float distancia = (preliminar[internoIzquierdo] + sumaInternoIzquierdo)
+                            - (preliminar[internoDerecho] + sumaInternoDerecho) + SEPARACION;
+            if (distancia > 0) {
+                int32_t izquierdo = padre[ancestro[internoIzquierdo]] == p ? ancestro[internoIzquierdo] : porOmision;
+                moverSubarbol(izquierdo, v, distancia);
+                sumaInternoDerecho += distancia;
+                sumaExternoDerecho += distancia;
+            }
+            sumaInternoIzquierdo += modificador[internoIzquierdo];
+            sumaInternoDerecho += modificador[internoDerecho];
+            sumaExternoIzquierdo += modificador[externoIzquierdo];
+            sumaExternoDerecho += modificador[externoDerecho];
+        }
+        if (siguienteDerecho(internoIzquierdo) != NINGUNO && siguienteDerecho(externoDerecho) == NINGUNO) {
+            hilo[externoDerecho] = siguienteDerecho(internoIzquierdo);
+            modificador[externoDerecho] += sumaInternoIzquierdo - sumaExternoDerecho;
+        }
+        if (siguienteIzquierdo(internoDerecho) != NINGUNO && siguienteIzquierdo(externoIzquierdo) == NINGUNO) {
+            hilo[externoIzquierdo] = siguienteIzquierdo(internoDerecho);
+            modificador[externoIzquierdo] += sumaInternoDerecho - sumaExternoIzquierdo;
+            porOmision = v;
+        }
+        return porOmision;
+    }
+
+    // Recorre 'derecho' y reparte el corrimiento entre los subarboles intermedios
+    void moverSubarbol(int32_t izquierdo, int32_t derecho, float distancia) {
+        float subarboles = float(numero[derecho] - numero[izquierdo]);
+        cambio[derecho] -= distancia / subarboles;
+        corrimiento[derecho] += distancia;
+        cambio[izquierdo] += distancia / subarboles;
+        preliminar[derecho] += distancia;
+        modificador[derecho] += distancia;
+    }
+
+    void ejecutarCorrimientos(int32_t v) {
+        float acumulado = 0, cambioAcumulado = 0;
+        for (int i = cantidadHijos[v] - 1; i >= 0; i--) {
+            int32_t w = hijos[v][i];
+            preliminar[w] += acumulado;
+            modificador[w] += acumulado;
+            cambioAcumulado += cambio[w];
+            acumulado += corrimiento[w] + cambioAcumulado;
+        }
+    }
+
+    vector<array<int32_t, 3>> hijos;
+    vector<uint8_t> cantidadHijos;
+    vector<uint8_t> numero; // Posicion entre sus hermanos
+    vector<int32_t> postorden;
+    vector<float> preliminar, modificador, cambio, corrimiento;
+    vector<int32_t> hilo, ancestro, ancestroPorOmision;
+};
+
 // Clase para manejar un árbol ternario
 class ArbolTernario {
 public:
     Nodo* raiz; // Nodo raíz del árbol
+    size_t nodos; // Nodos creados para la expresion actual
 
     // Constructor
-    ArbolTernario() : raiz(nullptr) {}
+    ArbolTernario() : raiz(nullptr), nodos(0) {}
 
-    // Inserta un nuevo nodo en el árbol
-    void insertar(const string& val, Nodo*& nodo, Nodo* padre = nullptr) {
+    /* Inserta un nuevo nodo en el árbol, la memoria sale de la arena del arbol.
+    Para Simbolo::Literal el valor mostrado es el texto del literal */
+    void insertar(Simbolo simbolo, Nodo*& nodo, Nodo* padre = nullptr, string_view literal = {}) {
         if (nodo == nullptr) {
-            nodo = new Nodo(val);
+            string_view val = simbolo == Simbolo::Literal ? literal : string_view(nombreSimbolo(simbolo));
+            nodo = new (arena.reservar(sizeof(Nodo), alignof(Nodo))) Nodo(simbolo, val);
             nodo->padre = padre;
+            nodos++;
         }
     }
 
-    // Calcula la altura del árbol
+    // Libera el arbol completo en O(1) para reutilizar la memoria en la siguiente expresion
+    void reiniciar() {
+        raiz = nullptr;
+        nodos = 0;
+        arena.reiniciar();
+    }
+
+    size_t bytesUsados() const { return arena.bytesUsados(); }
+    size_t bytesReservados() const { return arena.bytesReservados(); }
+
+    /* Calcula la altura del árbol con una pila explicita en lugar de recursion, asi la
+    profundidad solo esta limitada por la memoria */
     int altura(Nodo* raiz) {
-        if (raiz == nullptr) {
-            return 0;
-        }
-        else {
-            int alturaIzquierda = altura(raiz->izquierdo);
-            int alturaMedia = altura(raiz->medio);
-            int alturaDerecha = altura(raiz->derecho);
-            return 1 + max({ alturaIzquierda, alturaMedia, alturaDerecha });
+        vector<pair<const Nodo*, int>> pila;
+        int maxima = 0;
+        if (raiz) pila.push_back({ raiz, 1 });
+        while (!pila.empty()) {
+            auto [nodo, nivel] = pila.back();
+            pila.pop_back();
+            maxima = max(maxima, nivel);
+            for (const Nodo* hijo : { nodo->izquierdo, nodo->medio, nodo->derecho }) {
+                if (hijo) pila.push_back({ hijo, nivel + 1 });
+            }
         }
+        return maxima;
     }
 
-    // Dibuja una línea entre dos puntos
-    void dibujarLinea(float x1, float y1, float x2, float y2) {
+    /* Dibuja el árbol con las posiciones ya calculadas, escaladas para caber en la ventana
+    ('zoom' las separa o junta en X). Todas las líneas van en un solo glBegin y los círculos de
+    los no terminales en un solo glDrawArrays con un círculo de 16 segmentos precalculado. Con
+    demasiados nodos no se dibujan los textos porque no cabrian */
+    void dibujarArbol(const DisposicionArbol& disposicion, float zoom) {
+        const size_t SEGMENTOS = 16;
+        const size_t LIMITE_ETIQUETAS = 5000;
+        static float circulo[SEGMENTOS + 1][2];
+        if (circulo[0][0] == 0) {
+            for (size_t i = 0; i <= SEGMENTOS; i++) {
+                float angulo = float(2 * M_PI * i / SEGMENTOS);
+                circulo[i][0] = cos(angulo);
+                circulo[i][1] = sin(angulo);
+            }
+        }
+
+        size_t n = disposicion.nodos.size();
+        if (n == 0) return;
+        float escalaX = 1.8f / max(disposicion.ancho(), 1.0f) * zoom;
+        float escalaY = min(0.2f, 1.8f / max(float(disposicion.profundidad()), 1.0f));
+        float mitad = disposicion.ancho() / 2;
+        float radio = min({ 0.05f, 0.4f * escalaX, 0.4f * escalaY });
+        auto posicionX = [&](size_t v) { return (disposicion.x[v] - mitad) * escalaX; };
+        auto posicionY = [&](size_t v) { return 0.9f - disposicion.nivel[v] * escalaY; };
+
+        // Líneas hacia los hijos
         glColor3f(1.0f, 1.0f, 1.0f); // Color de las líneas (blanco)
         glBegin(GL_LINES);
-        glVertex2f(x1, y1);
-        glVertex2f(x2, y2);
+        for (size_t v = 1; v < n; v++) {
+            size_t p = size_t(disposicion.padre[v]);
+            glVertex2f(posicionX(p), posicionY(p));
+            glVertex2f(posicionX(v), posicionY(v));
+        }
         glEnd();
-    }
 
-    // Dibuja un nodo en la pantalla
-    void dibujarNodo(float x, float y, const std::string& valor) {
-        if (valor != "+" && valor != "*" && valor != "(" && valor != ")" && valor != "NULL" && valor != "num" && !esNumero(valor)) {
-            // Dibujar un círculo para nodos que no son terminales
-            float radius = 0.05f;
-            glColor3f(0.0f, 0.0f, 1.0f); // Color del círculo azul
-            glBegin(GL_TRIANGLE_FAN);
-            glVertex2f(x, y);
-            for (int i = 0; i <= 100; i++) {
-                float angle = 2 * M_PI * i / 100;
-                glVertex2f(x + cos(angle) * radius, y + sin(angle) * radius);
+        // Círculos de los nodos que no son terminales
+        vector<float> triangulos;
+        for (size_t v = 0; v < n; v++) {
+            if (!esNoTerminal(disposicion.nodos[v]->simbolo)) continue;
+            float cx = posicionX(v), cy = posicionY(v);
+            for (size_t i = 0; i < SEGMENTOS; i++) {
+                triangulos.insert(triangulos.end(), { cx, cy,
+                    cx + circulo[i][0] * radio, cy + circulo[i][1] * radio,
+                    cx + circulo[i + 1][0] * radio, cy + circulo[i + 1][1] * radio });
             }
-            glEnd();
         }
+        glColor3f(0.0f, 0.0f, 1.0f); // Color del círculo azul
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(2, GL_FLOAT, 0, triangulos.data());
+        glDrawArrays(GL_TRIANGLES, 0, GLsizei(triangulos.size() / 2));
+        glDisableClientState(GL_VERTEX_ARRAY);
 
-        // Dibujar el valor del nodo
+        // Dibujar el valor de cada nodo
+        if (n > LIMITE_ETIQUETAS) return;
         glColor3f(1.0f, 1.0f, 1.0f); // Color del texto (blanco)
-        glRasterPos2f(x - 0.02f, y - 0.02f);
-        for (char c : valor) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
+        for (size_t v = 0; v < n; v++) {
+            glRasterPos2f(posicionX(v) - 0.02f, posicionY(v) - 0.02f);
+            for (char c : disposicion.nodos[v]->valor) {
+                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
+            }
         }
     }
 
-    // Dibuja el árbol entero
-    void dibujarArbol(Nodo* raiz, float x, float y, float offsetX, float offsetY) {
-        if (raiz == nullptr) return;
+private:
+    Arena arena; // Memoria de todos los nodos del arbol
+};
+
+/* Representacion alternativa del arbol como estructura de arreglos. Cada nodo es un indice de
+32 bits y sus campos viven en arreglos contiguos; los literales se guardan una sola vez en una
+tabla aparte. Los nodos se numeran por niveles, asi todo padre tiene un indice menor que sus
+hijos y los recorridos de abajo hacia arriba son pasadas lineales sobre memoria contigua */
+class ArbolCompacto {
+public:
+    static constexpr uint32_t NINGUNO = UINT32_MAX;
+
+    vector<Simbolo> simbolo;
+    vector<uint32_t> izquierdo;
+    vector<uint32_t> medio;
+    vector<uint32_t> derecho;
+    vector<uint32_t> padre;
+    vector<uint32_t> literal;        // Indice en 'literales' para Simbolo::Literal, NINGUNO en otro caso
+    vector<string_view> literales;   // Tabla de literales sin repetir
+
+    size_t nodos() const { return simbolo.size(); }
 
-        // Dibujar líneas hacia los hijos
-        if (raiz->izquierdo) {
-            float hijoX = x - offsetX;
-            float hijoY = y - offsetY;
-            dibujarLinea(x, y, hijoX, hijoY);
-            dibujarArbol(raiz->izquierdo, hijoX, hijoY, offsetX * 0.7f, offsetY);
+    // Construye la version compacta a partir del arbol de nodos recorriendolo por niveles
+    void desde(const ArbolTernario& arbol) {
+        simbolo.clear();
+        izquierdo.clear();
+        medio.clear();
+        derecho.clear();
+        padre.clear();
+        literal.clear();
+        literales.clear();
+        indiceLiteral.clear();
+        if (arbol.raiz == nullptr) return;
+        simbolo.reserve(arbol.nodos);
+        izquierdo.reserve(arbol.nodos);
+        medio.reserve(arbol.nodos);
+        derecho.reserve(arbol.nodos);
+        padre.reserve(arbol.nodos);
+        literal.reserve(arbol.nodos);
+
+        vector<const Nodo*> pendientes;
+        pendientes.reserve(arbol.nodos);
+        pendientes.push_back(arbol.raiz);
+        agregar(arbol.raiz, NINGUNO);
+        for (size_t i = 0; i < pendientes.size(); i++) {
+            const Nodo* nodo = pendientes[i];
+            const Nodo* hijos[3] = { nodo->izquierdo, nodo->medio, nodo->derecho };
+            vector<uint32_t>* campos[3] = { &izquierdo, &medio, &derecho };
+            for (int h = 0; h < 3; h++) {
+                if (hijos[h] != nullptr) {
+                    uint32_t id = agregar(hijos[h], uint32_t(i));
+                    (*campos[h])[i] = id;
+                    pendientes.push_back(hijos[h]);
+                }
+            }
         }
+    }
 
-        if (raiz->medio) {
-            float hijoX = x;
-            float hijoY = y - offsetY;
-            dibujarLinea(x, y, hijoX, hijoY);
-            dibujarArbol(raiz->medio, hijoX, hijoY, offsetX * 0.7f, offsetY);
+    /* Calcula la altura con una sola pasada: como los padres van antes que los hijos,
+    la profundidad de cada nodo es la de su padre mas uno */
+    int altura() const {
+        vector<int> profundidad(nodos());
+        int maxima = 0;
+        for (size_t i = 0; i < nodos(); i++) {
+            profundidad[i] = padre[i] == NINGUNO ? 1 : profundidad[padre[i]] + 1;
+            maxima = max(maxima, profundidad[i]);
         }
+        return maxima;
+    }
+
+    // Memoria ocupada por los arreglos (sin contar el texto de la entrada)
+    size_t bytes() const {
+        return simbolo.capacity() * sizeof(Simbolo)
+            + (izquierdo.capacity() + medio.capacity() + derecho.capacity() + padre.capacity() + literal.capacity()) * sizeof(uint32_t)
+            + literales.capacity() * sizeof(string_view);
+    }
+
+private:
+    unordered_map<string_view, uint32_t> indiceLiteral; // Para no repetir literales en la tabla
 
-        if (raiz->derecho) {
-            float hijoX = x + offsetX;
-            float hijoY = y - offsetY;
-            dibujarLinea(x, y, hijoX, hijoY);
-            dibujarArbol(raiz->derecho, hijoX, hijoY, offsetX * 0.7f, offsetY);
+    uint32_t agregar(const Nodo* nodo, uint32_t idPadre) {
+        uint32_t id = uint32_t(simbolo.size());
+        simbolo.push_back(nodo->simbolo);
+        izquierdo.push_back(NINGUNO);
+        medio.push_back(NINGUNO);
+        derecho.push_back(NINGUNO);
+        padre.push_back(idPadre);
+        if (nodo->simbolo == Simbolo::Literal) {
+            auto it = indiceLiteral.emplace(nodo->valor, uint32_t(literales.size())).first;
+            if (it->second == literales.size()) literales.push_back(nodo->valor);
+            literal.push_back(it->second);
         }
+        else {
+            literal.push_back(NINGUNO);
+        }
+        return id;
+    }
+};
 
-        // Dibujar el nodo actual
-        dibujarNodo(x, y, raiz->valor);
+// Operaciones del lenguaje intermedio
+enum class CodigoOp : uint8_t {
+    Cargar,         // t[d] = literal a
+    Variable,       // t[d] = variable a
+    Suma,           // t[d] = t[a] + t[b]
+    Resta,          // t[d] = t[a] - t[b]
+    Multiplicacion, // t[d] = t[a] * t[b]
+    Division,       // t[d] = t[a] / t[b]
+    Negacion,       // t[d] = - t[a]
+    Copia           // t[d] = t[a]
+};
+
+// Tipo de dato de un temporal, decide si se imprime to_int o to_float
+enum class TipoDato : uint8_t {
+    Entero,
+    Flotante
+};
+
+// Instruccion de tres direcciones del lenguaje intermedio
+struct Instruccion {
+    CodigoOp op;
+    TipoDato tipo;
+    uint32_t destino;
+    uint32_t a; // Primer operando, o indice del literal para Cargar y de la variable para Variable
+    uint32_t b; // Segundo operando de las operaciones binarias
+};
+
+// Lenguaje intermedio de una expresion: instrucciones mas la tabla de literales que cargan
+struct Programa {
+    vector<Instruccion> instrucciones;
+    vector<string_view> literales; // Texto de cada literal dentro de la entrada
+    vector<float> valores;         // Valor de cada literal ya convertido
+    vector<string_view> variables; // Nombre de cada variable distinta, en orden de aparicion
+    uint32_t temporales = 0;       // Tamaño del arreglo t[] que se necesita para evaluar
+    uint32_t resultado = 0;        // Temporal que contiene el valor de la expresion
+
+    void limpiar() {
+        instrucciones.clear();
+        literales.clear();
+        valores.clear();
+        variables.clear();
+        temporales = 0;
+        resultado = 0;
+    }
+
+    // Agrega a la tabla una constante calculada al compilar, sin texto en la entrada
+    uint32_t agregarConstante(float valor) {
+        literales.push_back(string_view());
+        valores.push_back(valor);
+        return uint32_t(valores.size() - 1);
     }
 
+    // Agrega una instruccion y regresa el temporal donde queda su resultado
+    uint32_t emitir(CodigoOp op, TipoDato tipo, uint32_t a, uint32_t b = 0) {
+        instrucciones.push_back({ op, tipo, temporales, a, b });
+        return temporales++;
+    }
 };
 
-// Instancia global del árbol ternario y variable de offset
-ArbolTernario arbol;
-float offsetX = 0.5f; // Valor inicial del offset en el eje X (Espacio entre nodos del mismo nivel)
+const char* simboloOperacion(CodigoOp op) {
+    switch (op) {
+    case CodigoOp::Suma: return "+";
+    case CodigoOp::Resta: return "-";
+    case CodigoOp::Multiplicacion: return "*";
+    case CodigoOp::Division: return "/";
+    case CodigoOp::Negacion: return "-";
+    default: return "";
+    }
+}
 
-// Inicializa la configuración de OpenGL
-void initOpenGL() {
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Fondo negro
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(-1.0, 1.0, -1.0, 1.0); // Coordenadas ortográficas
+bool esBinaria(CodigoOp op) {
+    return op == CodigoOp::Suma || op == CodigoOp::Resta || op == CodigoOp::Multiplicacion || op == CodigoOp::Division;
 }
 
-// Función de visualización de OpenGL
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT);
-    float x = 0.0f;
-    float y = 0.9f;
-    float offsetY = 0.2f; // Espacio entre niveles del arbol
-    arbol.dibujarArbol(arbol.raiz, x, y, offsetX, offsetY);
-    glFlush();
+// Cargar y Variable no leen temporales, el resto si
+bool usaTemporales(CodigoOp op) {
+    return op != CodigoOp::Cargar && op != CodigoOp::Variable;
 }
 
-/* Función para aumentar o disminuir el espacio entre nodos sobre X
-para evitar que los nodos se encimen o se salgan de la pantalla*/
-void teclado(unsigned char key, int x, int y) {
-    if (key == '+') {
-        offsetX += 0.1f; // Aumentar offsetX
+// Resultado de una operacion binaria, la division entre 0 la revisa quien llama
+float aplicarOperacion(CodigoOp op, float a, float b) {
+    switch (op) {
+    case CodigoOp::Suma: return a + b;
+    case CodigoOp::Resta: return a - b;
+    case CodigoOp::Multiplicacion: return a * b;
+    case CodigoOp::Division: return a / b;
+    default: return 0;
     }
-    else if (key == '-') {
-        offsetX -= 0.1f; // Disminuir offsetX
+}
+
+/* Salida del compilador sobre un bufer propio que se reutiliza. Textos y numeros se copian
+directo al bufer (los numeros con to_chars, sin locale ni estado de formato) y el bufer se
+entrega con una sola llamada a write al vaciarlo, normalmente una vez por lote de expresiones.
+Tambien es un ostream sobre el mismo bufer, para lo que imprime poco y no vale la pena cambiar */
+class SalidaBuffer : public ostream {
+public:
+    static constexpr size_t TAM_LOTE = 1 << 20; // Bytes acumulados antes de que vaciarSiLleno escriba
+    static constexpr int SALIDA_ESTANDAR = 1;
+    static constexpr int SALIDA_ERRORES = 2;
+
+    // Sin descriptor el texto solo se acumula en memoria (ver vista)
+    explicit SalidaBuffer(int descriptor = -1) : ostream(nullptr), descriptor(descriptor), adaptador(*this) {
+        rdbuf(&adaptador);
     }
-    else if (key == 27) {
-        exit(0);
+
+    ~SalidaBuffer() {
+        vaciar();
     }
-    glutPostRedisplay(); // Redibuja la ventana
-}
 
-// Tokenizar la cadena entrante, si detecta un simbolo no valido manda a errores
-void lexer(const string& entrada) {
-    size_t aux = 0;
-    string agregar;
-    string caracteres_validos = "0123456789.+*()-/";
+    SalidaBuffer& texto(string_view s) {
+        memcpy(reservar(s.size()), s.data(), s.size());
+        usado += s.size();
+        return *this;
+    }
 
-    for (int i = 0; i < entrada.size(); i++) {
-        if (caracteres_validos.find(entrada[i]) == string::npos && entrada[i] != ' ') {
-            agregar = entrada[i];
-            cadena.push_back(agregar);
-            errores(1); // Si encuentra un caracter no valido llama a la funcion errores
-        }
+    SalidaBuffer& caracter(char c) {
+        *reservar(1) = c;
+        usado++;
+        return *this;
+    }
+
+    SalidaBuffer& entero(uint64_t valor) {
+        char* inicio = reservar(20);
+        usado = size_t(to_chars(inicio, inicio + 20, valor).ptr - datos.data());
+        return *this;
+    }
+
+    // Mismo texto que << con el formato por omision de ostream (%g con 6 digitos)
+    SalidaBuffer& flotante(float valor) {
+        char* inicio = reservar(32);
+        usado = size_t(to_chars(inicio, inicio + 32, double(valor), chars_format::general, 6).ptr - datos.data());
+        return *this;
     }
 
-    while (aux < entrada.size()) {
+    // "t[i]"
+    SalidaBuffer& temporal(uint32_t indice) {
+        return texto("t[").entero(indice).caracter(']');
+    }
+
+    string_view vista() const {
+        return string_view(datos.data(), usado);
+    }
+
+    // Descarta lo acumulado sin escribirlo, conservando la memoria
+    void limpiar() {
+        usado = 0;
+    }
 
-        // Encontrar el siguiente operador o paréntesis
-        size_t pos = entrada.find_first_of(" +*()-/", aux);
-        
-        // Si no encuentra más operadores, procesa el resto de la cadena
-        if (pos == std::string::npos) {
-            agregar = entrada.substr(aux);
-            if (!agregar.empty()) {
-                cadena.push_back(agregar);
+    // Escribe lo acumulado en el descriptor con una sola llamada (salvo escrituras parciales)
+    void vaciar() {
+        if (descriptor < 0 || usado == 0) return;
+        cout.flush(); // Lo que se imprimio antes con cout sale primero
+#if USAR_WRITE
+        const char* pendiente = datos.data();
+        size_t restante = usado;
+        while (restante > 0) {
+            ssize_t escritos = ::write(descriptor, pendiente, restante);
+            if (escritos < 0) {
+                if (errno == EINTR) continue;
+                break;
             }
-            break;
+            pendiente += escritos;
+            restante -= size_t(escritos);
         }
+#else
+        (descriptor == SALIDA_ERRORES ? cerr : cout).write(datos.data(), streamsize(usado)).flush();
+#endif
+        usado = 0;
+    }
 
-        // Si hay texto antes del operador, lo agregamos como número o token
-        if (pos > aux) {
-            agregar = entrada.substr(aux, pos - aux);
-            cadena.push_back(agregar);
+    void vaciarSiLleno() {
+        if (usado >= TAM_LOTE) vaciar();
+    }
+
+private:
+    // Lleva lo que se escribe con << al bufer de la salida
+    class Adaptador : public streambuf {
+    public:
+        explicit Adaptador(SalidaBuffer& salida) : salida(salida) {}
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (c != traits_type::eof()) salida.caracter(char(c));
+            return traits_type::not_eof(c);
         }
 
-        // Si el operador no es un espacio, lo agregamos como token
-        if (entrada[pos] != ' ') {
-            agregar = entrada.substr(pos, 1);
-            cadena.push_back(agregar);
+        streamsize xsputn(const char* s, streamsize n) override {
+            salida.texto(string_view(s, size_t(n)));
+            return n;
         }
 
-        aux = pos + 1;
+    private:
+        SalidaBuffer& salida;
+    };
+
+    // Espacio para 'n' bytes mas, el bufer solo crece
+    char* reservar(size_t n) {
+        if (usado + n > datos.size()) datos.resize(max(datos.size() * 2, usado + n + 4096));
+        return datos.data() + usado;
     }
 
-    // Convertir números al token 'num' y almacenarlos en 'valores'
-    for (int i = 0; i < cadena.size(); i++) {
-        size_t pos2 = cadena[i].find_first_not_of("0123456789.");
-        if (pos2 == string::npos) {  // Es un número
-            valores.push_back(cadena[i]);
-            cadena[i] = "num";  // Reemplaza el número por el token 'num'
+    int descriptor;
+    vector<char> datos;
+    size_t usado = 0;
+    Adaptador adaptador;
+};
+
+/* Codigo de bytes para la maquina virtual. Cada instruccion es una palabra de operacion seguida
+de sus operandos (destino, operandos o indice de constante) en un solo arreglo contiguo */
+enum CodigoBytecode : uint32_t {
+    BC_CARGAR,         // d, k
+    BC_SUMA,           // d, a, b
+    BC_RESTA,          // d, a, b
+    BC_MULTIPLICACION, // d, a, b
+    BC_DIVISION,       // d, a, b
+    BC_NEGACION,       // d, a
+    BC_COPIA,          // d, a
+    BC_VARIABLE,       // d, v
+    BC_FIN
+};
+
+struct CodigoBytes {
+    vector<uint32_t> codigo;
+    vector<float> constantes;
+    uint32_t registros = 0;
+    uint32_t resultado = 0;
+    uint32_t variables = 0; // Cuantos valores de variables espera la ejecucion
+    bool flotante = false;
+};
+
+// Traduce el lenguaje intermedio a codigo de bytes, se hace una sola vez por expresion
+void compilarBytecode(const Programa& prog, CodigoBytes& cb) {
+    cb.codigo.clear();
+    cb.constantes.assign(prog.valores.begin(), prog.valores.end());
+    cb.registros = prog.temporales;
+    cb.resultado = prog.resultado;
+    cb.variables = uint32_t(prog.variables.size());
+    cb.flotante = prog.instrucciones.back().tipo == TipoDato::Flotante;
+    for (const Instruccion& ins : prog.instrucciones) {
+        switch (ins.op) {
+        case CodigoOp::Cargar:
+            cb.codigo.insert(cb.codigo.end(), { BC_CARGAR, ins.destino, ins.a });
+            break;
+        case CodigoOp::Variable:
+            cb.codigo.insert(cb.codigo.end(), { BC_VARIABLE, ins.destino, ins.a });
+            break;
+        case CodigoOp::Negacion:
+            cb.codigo.insert(cb.codigo.end(), { BC_NEGACION, ins.destino, ins.a });
+            break;
+        case CodigoOp::Copia:
+            cb.codigo.insert(cb.codigo.end(), { BC_COPIA, ins.destino, ins.a });
+            break;
+        default:
+            uint32_t op = ins.op == CodigoOp::Suma ? BC_SUMA
+                : ins.op == CodigoOp::Resta ? BC_RESTA
+                : ins.op == CodigoOp::Multiplicacion ? BC_MULTIPLICACION : BC_DIVISION;
+            cb.codigo.insert(cb.codigo.end(), { op, ins.destino, ins.a, ins.b });
+            break;
         }
     }
+    cb.codigo.push_back(BC_FIN);
 }
 
-// Si la cadena tokenizada es ambigua manda a error y no se procesa
-void encontrarAmbiguedad() {
-    for (int i = 0; i < cadena.size(); i++) {
-        if (cadena[i] == "+" || cadena[i] == "-") {
-            if (i + 2 < cadena.size() && (cadena[i + 2] == "+" || cadena[i + 2] == "-")) {
-                errores(2);
-                break;
-            }
-            else if (cadena[i + 1] == "(") {
-                for (int j = i; j < cadena.size(); j++) {
-                    if (cadena[j] == ")" && (j + 1 < cadena.size() && (cadena[j + 1] == "+" || cadena[j + 1] == "-"))) {
-                        errores(2);
-                        break;
-                    }
-                }
-                break;
-            }
-        }
-        else if (cadena[i] == "*" || cadena[i] == "/") {
-            if (i + 2 < cadena.size() && (cadena[i + 2] == "*" || cadena[i + 2] == "/")) {
-                errores(2);
-                break;
-            }
-            else if (cadena[i + 1] == "(") {
-                for (int j = i; j < cadena.size(); j++) {
-                    if (cadena[j] == ")" && (j + 1 < cadena.size() && (cadena[j + 1] == "*" || cadena[j + 1] == "/"))) {
-                        errores(2);
-                        break;
-                    }
-                }
-                break;
-            }
-        }
+// Con GCC y Clang el despacho usa goto calculado (una tabla de etiquetas), en otro caso un switch
+#if defined(__GNUC__) || defined(__clang__)
+#define USAR_GOTO_CALCULADO 1
+#else
+#define USAR_GOTO_CALCULADO 0
+#endif
+
+/* Maquina virtual de registros. El archivo de registros se reserva al preparar y se reutiliza
+en cada ejecucion, de modo que evaluar no reserva memoria ni hace E/S (salvo con traza) */
+class MaquinaVirtual {
+public:
+    void preparar(const CodigoBytes& cb) {
+        if (registros.size() < cb.registros) registros.resize(cb.registros);
     }
-}
 
-// Función para construir el árbol a partir de la cadena tokenizada
-/* Se manejaron las reglas de produccion de la gramatica a partir de if else */
-void parser() {
-    arbol.insertar("<E>", arbol.raiz);
-    Nodo* actual = arbol.raiz;
-
-    while (!cadena.empty()) {
-        if (actual == nullptr) break;
-
-        if (actual->valor == "<E>") {
-            string op = "-1";
-            size_t i;
-            for (i = 0; i < cadena.size(); i++) {
-                if (cadena[i] == "+") {
-                    op = "+";
-                    break;
-                }
-                else if (cadena[i] == "-" && i != 0) {
-                    if (cadena[i - 1] == "num") {
-                        op = "-";
-                        break;
-                    }
-                }
-                else if (cadena[i] == "(") {
-                    break;
-                }
-            }
+    /* Regresa 0 si todo salio bien o 4 si se intento dividir entre 0. 'variables' tiene un valor
+    por cada variable del programa, en el orden de su tabla */
+    int ejecutar(const CodigoBytes& cb, float& resultado, const float* variables = nullptr) {
+        return despachar<false>(cb, resultado, variables, nullptr);
+    }
 
-            if (op == "+") {
-                arbol.insertar("<E>", actual->izquierdo, actual);
-                arbol.insertar("+", actual->medio, actual);
-                arbol.insertar("<T>", actual->derecho, actual);
-                cadena.erase(cadena.begin() + i);
-                actual = actual->izquierdo;
-            }
-            else if (op == "-") {
-                arbol.insertar("<E>", actual->izquierdo, actual);
-                arbol.insertar("-", actual->medio, actual);
-                arbol.insertar("<T>", actual->derecho, actual);
-                cadena.erase(cadena.begin() + i);
-                actual = actual->izquierdo;
-            }
-            else {
-                arbol.insertar("NULL", actual->izquierdo, actual);
-                arbol.insertar("<T>", actual->medio, actual);
-                arbol.insertar("NULL", actual->derecho, actual);
-                actual = actual->medio;
-            }
-        }
-        else if (actual->valor == "<T>") {
-            string op = "-1";
-            size_t i;
-            for (i = 0; i < cadena.size(); i++) {
-                if (cadena[i] == "*") {
-                    op = "*";
-                    break;
-                }
-                else if (cadena[i] == "/") {
-                    op = "/";
-                    break;
-                }
-                else if (cadena[i] == "(") {
-                    op = "(";
-                    break;
-                }
-            }
+    // Igual que ejecutar pero escribe cada paso en 'traza'
+    int ejecutarConTraza(const CodigoBytes& cb, float& resultado, SalidaBuffer& traza, const float* variables = nullptr) {
+        return despachar<true>(cb, resultado, variables, &traza);
+    }
 
-            if (op == "*") {
-                arbol.insertar("<T>", actual->izquierdo, actual);
-                arbol.insertar("*", actual->medio, actual);
-                arbol.insertar("<T>", actual->derecho, actual);
-                cadena.erase(cadena.begin() + i);
-                actual = actual->izquierdo;
-            }
-            else if (op == "/") {
-                arbol.insertar("<T>", actual->izquierdo, actual);
-                arbol.insertar("/", actual->medio, actual);
-                arbol.insertar("<T>", actual->derecho, actual);
-                cadena.erase(cadena.begin() + i);
-                actual = actual->izquierdo;
-            }
-            else {
-                arbol.insertar("NULL", actual->izquierdo, actual);
-                arbol.insertar("<U>", actual->medio, actual);
-                arbol.insertar("NULL", actual->derecho, actual);
-                actual = actual->medio;
-            }
-        }
-        else if (actual->valor == "<U>") {
-            string op = "-1";
-            size_t i;
-            for (i = 0; i < cadena.size(); i++) {
-                if (cadena[i] == "num") {
-                    op = "num";
-                    break;
-                }
-                else if (cadena[i] == "-") {
-                    op = "-";
-                    break;
-                }
-                else if (cadena[i] == "(") {
-                    op = "(";
-                    break;
-                }
-            }
+private:
+    vector<float> registros;
 
-            if (op == "(") {
-                arbol.insertar("(", actual->izquierdo, actual);
-                arbol.insertar("<E>", actual->medio, actual);
-                arbol.insertar(")", actual->derecho, actual);
-                cadena.erase(cadena.begin() + i);
-                for (size_t j = 0; j < cadena.size(); j++) {
-                    if (cadena[j] == ")") {
-                        cadena.erase(cadena.begin() + j);
-                        break;
-                    }
-                }
-                actual = actual->medio;
-            }
-            else if (op == "-") {
-                arbol.insertar("-", actual->izquierdo, actual);
-                arbol.insertar("<U>", actual->medio, actual);
-                arbol.insertar("NULL", actual->derecho, actual);
-                actual = actual->medio;
-            }
-            else if (op == "num") {
-                arbol.insertar("NULL", actual->izquierdo, actual);
-                arbol.insertar("num", actual->medio, actual);
-                arbol.insertar("NULL", actual->derecho, actual);
-                cadena.erase(cadena.begin() + i);
-
-                if (valores.size() > 0) {
-                    arbol.insertar(valores[0], actual->medio->medio);
-                    arbol.insertar("NULL", actual->medio->izquierdo);
-                    arbol.insertar("NULL", actual->medio->derecho);
-                    valores.erase(valores.begin());
-                    ultimos.push_back(actual->medio->medio); /*Guarda el ultimo nodo para
-                    posteriormente recorrer mas facilmente el arbol de abajo hacia arriba*/
-                }
+    template <bool TRAZA>
+    int despachar(const CodigoBytes& cb, float& resultado, const float* variables, SalidaBuffer* traza) {
+        float* r = registros.data();
+        const float* k = cb.constantes.data();
+        const uint32_t* pc = cb.codigo.data();
 
-                actual = actual->padre;
-                while (actual != nullptr) {
-                    if (actual->valor == "<T>" && actual->medio != nullptr && (actual->medio->valor == "*" || actual->medio->valor == "/") && actual->derecho->medio == nullptr) {
-                        operaciones.push_back(actual->medio->valor); /*Guarda las operaciones en una pila*/
-                        actual = actual->derecho;
-                        break;
-                    }
-                    else if (actual->valor == "<E>" && actual->medio != nullptr && (actual->medio->valor == "+" || actual->medio->valor == "-") && actual->derecho->medio == nullptr) {
-                        operaciones.push_back(actual->medio->valor); /*Guarda las operaciones en una pila*/
-                        actual = actual->derecho;
-                        break;
-                    }
-                    actual = actual->padre;
-                }
-            }
+#if USAR_GOTO_CALCULADO
+        static void* const etiquetas[] = {
+            &&et_BC_CARGAR, &&et_BC_SUMA, &&et_BC_RESTA, &&et_BC_MULTIPLICACION,
+            &&et_BC_DIVISION, &&et_BC_NEGACION, &&et_BC_COPIA, &&et_BC_VARIABLE, &&et_BC_FIN
+        };
+#define CASO(op) et_##op:
+#define SIGUIENTE() goto *etiquetas[*pc]
+        SIGUIENTE();
+#else
+#define CASO(op) case op:
+#define SIGUIENTE() continue
+        for (;;) switch (*pc) {
+#endif
+        CASO(BC_CARGAR)
+            r[pc[1]] = k[pc[2]];
+            if (TRAZA) traza->temporal(pc[1]).texto(" = ").flotante(r[pc[1]]).caracter('\n');
+            pc += 3;
+            SIGUIENTE();
+        CASO(BC_SUMA)
+            r[pc[1]] = r[pc[2]] + r[pc[3]];
+            if (TRAZA) traza->temporal(pc[1]).texto(" = ").flotante(r[pc[2]]).texto(" + ").flotante(r[pc[3]]).caracter('\n');
+            pc += 4;
+            SIGUIENTE();
+        CASO(BC_RESTA)
+            r[pc[1]] = r[pc[2]] - r[pc[3]];
+            if (TRAZA) traza->temporal(pc[1]).texto(" = ").flotante(r[pc[2]]).texto(" - ").flotante(r[pc[3]]).caracter('\n');
+            pc += 4;
+            SIGUIENTE();
+        CASO(BC_MULTIPLICACION)
+            r[pc[1]] = r[pc[2]] * r[pc[3]];
+            if (TRAZA) traza->temporal(pc[1]).texto(" = ").flotante(r[pc[2]]).texto(" * ").flotante(r[pc[3]]).caracter('\n');
+            pc += 4;
+            SIGUIENTE();
+        CASO(BC_DIVISION)
+            if (TRAZA) traza->temporal(pc[1]).texto(" = ").flotante(r[pc[2]]).texto(" / ").flotante(r[pc[3]]).caracter('\n');
+            if (r[pc[3]] == 0) return 4;
+            r[pc[1]] = r[pc[2]] / r[pc[3]];
+            pc += 4;
+            SIGUIENTE();
+        CASO(BC_NEGACION)
+            r[pc[1]] = -r[pc[2]];
+            if (TRAZA) traza->temporal(pc[1]).texto(" = - ").flotante(r[pc[2]]).caracter('\n');
+            pc += 3;
+            SIGUIENTE();
+        CASO(BC_COPIA)
+            r[pc[1]] = r[pc[2]];
+            if (TRAZA) traza->temporal(pc[1]).texto(" = ").flotante(r[pc[1]]).caracter('\n');
+            pc += 3;
+            SIGUIENTE();
+        CASO(BC_VARIABLE)
+            r[pc[1]] = variables[pc[2]];
+            if (TRAZA) traza->temporal(pc[1]).texto(" = ").flotante(r[pc[1]]).caracter('\n');
+            pc += 3;
+            SIGUIENTE();
+        CASO(BC_FIN)
+            resultado = r[cb.resultado];
+            return 0;
+#if !USAR_GOTO_CALCULADO
         }
+#endif
+#undef CASO
+#undef SIGUIENTE
     }
-}
-
-// Funcion prototipo de la sustitucion de valores especificos
-void resolverOperacion(vector<string>&);
+};
 
-// Genera el lenguaje intermedio (Representacion interna)
-void generarLenguaje() {
-    int indice = 0;
-    vector<string> num;
-    vector<string> interno;
+/* Nucleos vectoriales para evaluar una expresion sobre muchas filas a la vez. Cada nucleo aplica
+una operacion a 'n' carriles contiguos; el de division marca en 'cero' los carriles cuyo divisor
+es 0 en lugar de detener la evaluacion */
+struct NucleosVectoriales {
+    const char* nombre;
+    void (*suma)(float* d, const float* a, const float* b, size_t n);
+    void (*resta)(float* d, const float* a, const float* b, size_t n);
+    void (*multiplicacion)(float* d, const float* a, const float* b, size_t n);
+    void (*division)(float* d, const float* a, const float* b, size_t n, uint8_t* cero);
+    void (*negacion)(float* d, const float* a, size_t n);
+};
 
-    cout << "Representacion Interna\n";
-    // Guardar los valores de las hojas en el vector num
-    for (int i = 0; i < ultimos.size(); i++) {
-        cout << "t[" << indice << "] = " << ultimos[i]->valor << "\n";
-        num.push_back("t[" + to_string(indice) + "]");
-        interno.push_back("t[" + to_string(indice) + "] = " + ultimos[i]->valor);
-        indice++;
+// Version escalar, tambien termina los carriles que sobran en las versiones SIMD
+void sumaEscalar(float* d, const float* a, const float* b, size_t n) {
+    for (size_t i = 0; i < n; i++) d[i] = a[i] + b[i];
+}
+void restaEscalar(float* d, const float* a, const float* b, size_t n) {
+    for (size_t i = 0; i < n; i++) d[i] = a[i] - b[i];
+}
+void multiplicacionEscalar(float* d, const float* a, const float* b, size_t n) {
+    for (size_t i = 0; i < n; i++) d[i] = a[i] * b[i];
+}
+void divisionEscalar(float* d, const float* a, const float* b, size_t n, uint8_t* cero) {
+    for (size_t i = 0; i < n; i++) {
+        cero[i] |= b[i] == 0;
+        d[i] = a[i] / b[i];
     }
+}
+void negacionEscalar(float* d, const float* a, size_t n) {
+    for (size_t i = 0; i < n; i++) d[i] = -a[i];
+}
 
-    // Generar las operaciones desde las hojas hacia la raíz
-    while (!operaciones.empty()) {
-        // Tomar los dos últimos elementos del vector num
-        string operandoDerecho = num.back();
-        num.pop_back();
-        string operandoIzquierdo = num.back();
-        num.pop_back();
+const NucleosVectoriales nucleosEscalares = {
+    "escalar", sumaEscalar, restaEscalar, multiplicacionEscalar, divisionEscalar, negacionEscalar
+};
 
-        // Obtener la última operación
-        string operacion = operaciones.back();
-        operaciones.pop_back();
+#if USAR_SIMD_X86
+// SSE: 4 carriles por instruccion, disponible en todo procesador x86-64
+void sumaSse(float* d, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(d + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sumaEscalar(d + i, a + i, b + i, n - i);
+}
+void restaSse(float* d, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(d + i, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    restaEscalar(d + i, a + i, b + i, n - i);
+}
+void multiplicacionSse(float* d, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(d + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    multiplicacionEscalar(d + i, a + i, b + i, n - i);
+}
+void divisionSse(float* d, const float* a, const float* b, size_t n, uint8_t* cero) {
+    const __m128 ceros = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 divisor = _mm_loadu_ps(b + i);
+        int mascara = _mm_movemask_ps(_mm_cmpeq_ps(divisor, ceros));
+        if (mascara) {
+            for (int k = 0; k < 4; k++) cero[i + k] |= (mascara >> k) & 1;
+        }
+        _mm_storeu_ps(d + i, _mm_div_ps(_mm_loadu_ps(a + i), divisor));
+    }
+    divisionEscalar(d + i, a + i, b + i, n - i, cero + i);
+}
+void negacionSse(float* d, const float* a, size_t n) {
+    const __m128 signo = _mm_set1_ps(-0.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(d + i, _mm_xor_ps(_mm_loadu_ps(a + i), signo));
+    negacionEscalar(d + i, a + i, n - i);
+}
 
-        // Generar el nuevo temporal para la operación
-        string instruccion = "t[" + to_string(indice) + "] = " + operandoIzquierdo + " " + operacion + " " + operandoDerecho;
-        interno.push_back(instruccion); /*Guarda los pasos para despues procesarlos*/
-        cout << instruccion << "\n";
+const NucleosVectoriales nucleosSse = {
+    "sse", sumaSse, restaSse, multiplicacionSse, divisionSse, negacionSse
+};
 
-        // Guardar el nuevo temporal en num
-        num.push_back("t[" + to_string(indice) + "]");
-        indice++;
+// AVX2: 8 carriles por instruccion, solo se usa si el procesador lo reporta al ejecutar
+__attribute__((target("avx2"))) void sumaAvx2(float* d, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(d + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    sumaEscalar(d + i, a + i, b + i, n - i);
+}
+__attribute__((target("avx2"))) void restaAvx2(float* d, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(d + i, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    restaEscalar(d + i, a + i, b + i, n - i);
+}
+__attribute__((target("avx2"))) void multiplicacionAvx2(float* d, const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(d + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    multiplicacionEscalar(d + i, a + i, b + i, n - i);
+}
+__attribute__((target("avx2"))) void divisionAvx2(float* d, const float* a, const float* b, size_t n, uint8_t* cero) {
+    const __m256 ceros = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 divisor = _mm256_loadu_ps(b + i);
+        int mascara = _mm256_movemask_ps(_mm256_cmp_ps(divisor, ceros, _CMP_EQ_OQ));
+        if (mascara) {
+            for (int k = 0; k < 8; k++) cero[i + k] |= (mascara >> k) & 1;
+        }
+        _mm256_storeu_ps(d + i, _mm256_div_ps(_mm256_loadu_ps(a + i), divisor));
     }
-    interno.push_back("t[" + to_string(indice) + "] = t[" + to_string(indice-1) + "]");
-    cout << interno.back() << "\n\n";
-    resolverOperacion(interno);
+    divisionEscalar(d + i, a + i, b + i, n - i, cero + i);
+}
+__attribute__((target("avx2"))) void negacionAvx2(float* d, const float* a, size_t n) {
+    const __m256 signo = _mm256_set1_ps(-0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) _mm256_storeu_ps(d + i, _mm256_xor_ps(_mm256_loadu_ps(a + i), signo));
+    negacionEscalar(d + i, a + i, n - i);
 }
 
-// Genera el lenguaje intermedio (Sustitucion de valores)
-void resolverOperacion(vector<string>& operaciones) {
-    int flotantes = 0;
-    vector<float> t(operaciones.size());
+const NucleosVectoriales nucleosAvx2 = {
+    "avx2", sumaAvx2, restaAvx2, multiplicacionAvx2, divisionAvx2, negacionAvx2
+};
+#endif
+
+/* Elige los nucleos al ejecutar: el preferido si se pidio y el procesador lo soporta,
+si no el mas ancho disponible */
+const NucleosVectoriales& seleccionarNucleos(const string& preferido) {
+#if USAR_SIMD_X86
+    bool hayAvx2 = __builtin_cpu_supports("avx2");
+    if (preferido == "escalar") return nucleosEscalares;
+    if (preferido == "sse") return nucleosSse;
+    return hayAvx2 ? nucleosAvx2 : nucleosSse;
+#else
+    return nucleosEscalares;
+#endif
+}
+
+/* Evalua un programa sobre columnas de datos por bloques de filas. Cada temporal ocupa un bloque
+de registros; las variables y las copias no copian datos, solo apuntan a la columna o al
+registro de origen */
+class EvaluadorColumnas {
+public:
+    static constexpr size_t BLOQUE = 1024;
+
+    /* 'columnas' tiene un arreglo de 'filas' valores por variable del programa. Escribe el valor de
+    cada fila en 'resultados' y marca en 'divisionEntreCero' las filas donde se dividio entre 0 */
+    void evaluar(const Programa& prog, const vector<const float*>& columnas, size_t filas,
+                 float* resultados, uint8_t* divisionEntreCero, const NucleosVectoriales& nucleos) {
+        registros.resize(size_t(prog.temporales) * BLOQUE);
+        fuente.resize(prog.temporales);
+        fill(divisionEntreCero, divisionEntreCero + filas, 0);
+
+        for (size_t inicio = 0; inicio < filas; inicio += BLOQUE) {
+            size_t n = min(BLOQUE, filas - inicio);
+            for (const Instruccion& ins : prog.instrucciones) {
+                float* d = &registros[size_t(ins.destino) * BLOQUE];
+                switch (ins.op) {
+                case CodigoOp::Cargar:
+                    fill(d, d + n, prog.valores[ins.a]);
+                    break;
+                case CodigoOp::Variable:
+                    fuente[ins.destino] = columnas[ins.a] + inicio;
+                    continue;
+                case CodigoOp::Copia:
+                    fuente[ins.destino] = fuente[ins.a];
+                    continue;
+                case CodigoOp::Negacion:
+                    nucleos.negacion(d, fuente[ins.a], n);
+                    break;
+                case CodigoOp::Suma:
+                    nucleos.suma(d, fuente[ins.a], fuente[ins.b], n);
+                    break;
+                case CodigoOp::Resta:
+                    nucleos.resta(d, fuente[ins.a], fuente[ins.b], n);
+                    break;
+                case CodigoOp::Multiplicacion:
+                    nucleos.multiplicacion(d, fuente[ins.a], fuente[ins.b], n);
+                    break;
+                case CodigoOp::Division:
+                    nucleos.division(d, fuente[ins.a], fuente[ins.b], n, divisionEntreCero + inicio);
+                    break;
+                }
+                fuente[ins.destino] = d;
+            }
+            copy(fuente[prog.resultado], fuente[prog.resultado] + n, resultados + inicio);
+        }
+    }
+
+private:
+    vector<float> registros;
+    vector<const float*> fuente; // Donde esta el bloque actual de cada temporal
+};
+
+/* Estado de una regla pendiente del parser iterativo: la regla, el paso en el que se quedo y
+los nodos que en la version recursiva serian variables locales */
+struct MarcoParser {
+    Simbolo regla;    // E, T o U
+    uint8_t paso;
+    Nodo** destino;   // Donde se guarda el nodo de la regla
+    Nodo* padre;
+    Nodo* actual;
+    Nodo* nuevo;      // <T> que agrupa la operacion en curso
+    Nodo* derecho;    // Operando derecho de la multiplicacion o division en curso
+};
+
+// Nodo pendiente de un recorrido en postorden con pila explicita
+struct PasoRecorrido {
+    const Nodo* nodo;
+    uint8_t etapa; // Hijos ya generados
+};
+
+// Regla pendiente de la traduccion sin arbol: E, T o U, el paso y el operador por aplicar
+struct MarcoTraduccion {
+    Simbolo regla;
+    uint8_t paso;
+    TipoToken operador;
+};
+
+/* Conteo de memoria dinamica para --stats. Los operadores new y delete globales pasan por
+malloc y free; solo cuando 'contarMemoria' esta activo se suman las asignaciones del hilo y
+los bytes vivos (con malloc_usable_size en glibc), asi desactivado cuesta una comparacion */
+struct ContadorMemoria {
+    uint64_t asignaciones = 0;
+    int64_t vivos = 0; // Puede ser negativo si se libera memoria asignada antes de activar el conteo
+    int64_t pico = 0;
+};
+thread_local ContadorMemoria memoriaHilo;
+bool contarMemoria = false;
+
+void* operator new(size_t bytes) {
+    void* p = malloc(bytes ? bytes : 1);
+    if (!p) throw bad_alloc();
+    if (contarMemoria) {
+        memoriaHilo.asignaciones++;
+#if USAR_TAMANO_MALLOC
+        memoriaHilo.vivos += malloc_usable_size(p);
+        memoriaHilo.pico = max(memoriaHilo.pico, memoriaHilo.vivos);
+#endif
+    }
+    return p;
+}
+
+// Sin inline, si no GCC ve el free dentro de cada delete y lo reporta como mal emparejado con new
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void* p) noexcept {
+#if USAR_TAMANO_MALLOC
+    if (p && contarMemoria) memoriaHilo.vivos -= malloc_usable_size(p);
+#endif
+    free(p);
+}
+
+void* operator new[](size_t bytes) { return operator new(bytes); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+// Fases medidas con --stats
+enum class Fase : uint8_t { Lexer, Parser, Generacion, Optimizacion, Evaluacion, Total };
+constexpr size_t NUM_FASES = 6;
+const char* const nombresFase[NUM_FASES] = { "lexer", "parser", "generarLenguaje", "optimizar", "evaluacion", "total" };
+
+// Mediciones de una expresion, se llenan solo con --stats
+struct Estadisticas {
+    double segundos[NUM_FASES] = {};
+    uint64_t asignaciones = 0; // Llamadas a new durante la expresion
+    uint64_t picoBytes = 0;    // Maximo de memoria dinamica viva por encima de la del inicio
+
+    void limpiar() {
+        *this = Estadisticas();
+    }
+};
+
+// Salida estandar del modo interactivo y de los contextos que no eligen otra
+SalidaBuffer salidaEstandar(SalidaBuffer::SALIDA_ESTANDAR);
+
+// Contexto de compilacion de una expresion: tokens, arbol y lenguaje intermedio.
+// Cada linea del modo por lotes usa el mismo contexto reiniciandolo entre lineas
+struct Contexto {
+    string_view entrada;      // Expresion a compilar, prestada del lector de lineas o de 'almacen'
+    string almacen;           // Copia propia de la entrada cuando no hay quien la conserve
+    vector<Token> cadena;
+    ArbolTernario arbol;
+    Programa programa;
+    CodigoBytes bytecode;
+    MaquinaVirtual maquina; // Conserva sus registros entre expresiones
+    int error = 0;           // Codigo del primer error encontrado (0 si no hubo)
+    size_t posicionError = 0; // Posicion en la entrada del caracter o literal con error
+    string detalleError;      // Nombre de la variable sin valor (error 6)
+    SalidaBuffer* salida = &salidaEstandar; // Destino de la salida de cada fase
+    Estadisticas estadisticas; // Tiempos y memoria de cada fase (--stats)
+    vector<MarcoParser> pilaParser;       // Pilas de los recorridos, conservan su memoria entre expresiones
+    vector<PasoRecorrido> pilaRecorrido;
+    vector<uint32_t> pilaTemporales;
+    vector<MarcoTraduccion> pilaTraduccion;
+    float resultado = 0;      // Valor de la expresion si la evaluacion termino sin error
+    string claveCache;        // Clave de la expresion en la cache de programas (--cache)
+    bool resultadoEnCache = false; // La cache ya tenia el resultado y no hace falta evaluar
+
+    // Deja el contexto listo para la siguiente expresion conservando la memoria reservada
+    void reiniciar() {
+        entrada = {};
+        almacen.clear();
+        cadena.clear();
+        arbol.reiniciar();
+        programa.limpiar();
+        error = 0;
+        posicionError = 0;
+        detalleError.clear();
+        estadisticas.limpiar();
+        resultado = 0;
+        claveCache.clear();
+        resultadoEnCache = false;
+    }
+
+    // Texto original de un token dentro de la entrada
+    string_view texto(const Token& token) const {
+        return entrada.substr(token.inicio, token.longitud);
+    }
+};
+
+// Prototipo de la funcion errores
+void errores(Contexto&, int);
+
+// Instancia global del contexto (modo interactivo), la disposicion de su arbol y el zoom
+Contexto contexto;
+DisposicionArbol disposicion;
+float zoom = 1.0f; // Escala en el eje X sobre el arbol ajustado a la ventana
+
+// Inicializa la configuración de OpenGL
+void initOpenGL() {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Fondo negro
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(-1.0, 1.0, -1.0, 1.0); // Coordenadas ortográficas
+}
+
+// Función de visualización de OpenGL
+void display() {
+    glClear(GL_COLOR_BUFFER_BIT);
+    contexto.arbol.dibujarArbol(disposicion, zoom);
+    glFlush();
+}
+
+/* Función para acercar o alejar el arbol sobre X. La disposicion ya evita que los nodos se
+encimen, el zoom solo sirve para ver de cerca arboles anchos */
+void teclado(unsigned char key, int x, int y) {
+    if (key == '+') {
+        zoom *= 1.25f; // Acercar
+    }
+    else if (key == '-') {
+        zoom /= 1.25f; // Alejar
+    }
+    else if (key == 27) {
+        exit(0);
+    }
+    glutPostRedisplay(); // Redibuja la ventana
+}
+
+// Los identificadores de variables empiezan con letra o guion bajo
+bool esInicioIdentificador(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+/* Clases de caracter del lexer como bits. La clase de un byte es el AND de dos tablas de 16
+entradas indexadas por su nibble alto y su nibble bajo; asi cada tabla cabe en un registro y
+las versiones SIMD clasifican 16 o 32 bytes con dos pshufb. Las letras necesitan dos bits
+porque sus nibbles bajos validos dependen del nibble alto (A-O y P-Z) */
+enum ClaseCaracter : uint8_t {
+    CC_ESPACIO = 1,
+    CC_OPERADOR = 2,   // + - * /
+    CC_PARENTESIS = 4,
+    CC_PUNTO = 8,
+    CC_DIGITO = 16,
+    CC_LETRA_A = 32,   // A-O, a-o
+    CC_LETRA_B = 64,   // P-Z, p-z
+    CC_GUION = 128     // _
+};
+constexpr uint8_t CC_LETRA = CC_LETRA_A | CC_LETRA_B | CC_GUION;
+constexpr uint8_t CC_SIMPLE = CC_OPERADOR | CC_PARENTESIS;
+
+alignas(16) constexpr uint8_t NIBBLE_ALTO[16] = {
+    0, 0, CC_ESPACIO | CC_OPERADOR | CC_PARENTESIS | CC_PUNTO, CC_DIGITO,
+    CC_LETRA_A, CC_LETRA_B | CC_GUION, CC_LETRA_A, CC_LETRA_B,
+    0, 0, 0, 0, 0, 0, 0, 0
+};
+alignas(16) constexpr uint8_t NIBBLE_BAJO[16] = {
+    CC_ESPACIO | CC_DIGITO | CC_LETRA_B,                               // ' ' 0 P p
+    CC_DIGITO | CC_LETRA_A | CC_LETRA_B, CC_DIGITO | CC_LETRA_A | CC_LETRA_B,
+    CC_DIGITO | CC_LETRA_A | CC_LETRA_B, CC_DIGITO | CC_LETRA_A | CC_LETRA_B,
+    CC_DIGITO | CC_LETRA_A | CC_LETRA_B, CC_DIGITO | CC_LETRA_A | CC_LETRA_B,
+    CC_DIGITO | CC_LETRA_A | CC_LETRA_B,
+    CC_PARENTESIS | CC_DIGITO | CC_LETRA_A | CC_LETRA_B,               // ( 8 H X
+    CC_PARENTESIS | CC_DIGITO | CC_LETRA_A | CC_LETRA_B,               // ) 9 I Y
+    CC_OPERADOR | CC_LETRA_A | CC_LETRA_B,                             // * J Z
+    CC_OPERADOR | CC_LETRA_A,                                          // + K
+    CC_LETRA_A,                                                        // L
+    CC_OPERADOR | CC_LETRA_A,                                          // - M
+    CC_PUNTO | CC_LETRA_A,                                             // . N
+    CC_OPERADOR | CC_LETRA_A | CC_GUION                                // / O _
+};
+
+constexpr uint8_t claseCaracter(unsigned char c) {
+    return NIBBLE_ALTO[c >> 4] & NIBBLE_BAJO[c & 15];
+}
+static_assert(claseCaracter(' ') == CC_ESPACIO && claseCaracter('/') == CC_OPERADOR && claseCaracter(')') == CC_PARENTESIS
+              && claseCaracter('.') == CC_PUNTO && claseCaracter('9') == CC_DIGITO && claseCaracter('O') == CC_LETRA_A
+              && claseCaracter('z') == CC_LETRA_B && claseCaracter('_') == CC_GUION && claseCaracter(',') == 0
+              && claseCaracter('[') == 0 && claseCaracter('`') == 0 && claseCaracter('\t') == 0 && claseCaracter(0x80) == 0,
+              "Las tablas de nibbles no reproducen las clases de caracter");
+
+// Mascaras de un bloque de 64 bytes: el bit i corresponde al byte i del bloque
+struct MascarasBloque {
+    uint64_t digito, punto, letra, simple, valido;
+};
+
+// Clasificador de bloques elegido al ejecutar, igual que NucleosVectoriales
+struct ClasificadorCaracteres {
+    const char* nombre;
+    void (*clasificar)(const char* bloque, MascarasBloque& m);
+};
+
+void clasificarEscalar(const char* bloque, MascarasBloque& m) {
+    m = {};
+    for (unsigned i = 0; i < 64; i++) {
+        uint8_t clase = claseCaracter(bloque[i]);
+        m.digito |= uint64_t((clase & CC_DIGITO) != 0) << i;
+        m.punto |= uint64_t((clase & CC_PUNTO) != 0) << i;
+        m.letra |= uint64_t((clase & CC_LETRA) != 0) << i;
+        m.simple |= uint64_t((clase & CC_SIMPLE) != 0) << i;
+        m.valido |= uint64_t(clase != 0) << i;
+    }
+}
+
+const ClasificadorCaracteres clasificadorEscalar = { "escalar", clasificarEscalar };
+
+#if USAR_SIMD_X86
+// SSSE3: 16 bytes por pshufb. Bits de 'clase' que tienen algun bit de 'grupo'
+__attribute__((target("ssse3"))) inline uint64_t bitsSse(__m128i clase, uint8_t grupo) {
+    __m128i sinGrupo = _mm_cmpeq_epi8(_mm_and_si128(clase, _mm_set1_epi8(char(grupo))), _mm_setzero_si128());
+    return uint64_t(~_mm_movemask_epi8(sinGrupo) & 0xFFFF);
+}
+__attribute__((target("ssse3"))) void clasificarSse(const char* bloque, MascarasBloque& m) {
+    const __m128i alta = _mm_load_si128(reinterpret_cast<const __m128i*>(NIBBLE_ALTO));
+    const __m128i baja = _mm_load_si128(reinterpret_cast<const __m128i*>(NIBBLE_BAJO));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    m = {};
+    for (unsigned k = 0; k < 64; k += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bloque + k));
+        __m128i clase = _mm_and_si128(_mm_shuffle_epi8(alta, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)),
+                                      _mm_shuffle_epi8(baja, _mm_and_si128(v, nibble)));
+        m.digito |= bitsSse(clase, CC_DIGITO) << k;
+        m.punto |= bitsSse(clase, CC_PUNTO) << k;
+        m.letra |= bitsSse(clase, CC_LETRA) << k;
+        m.simple |= bitsSse(clase, CC_SIMPLE) << k;
+        m.valido |= bitsSse(clase, 0xFF) << k;
+    }
+}
+
+// AVX2: 32 bytes por vpshufb, que busca en cada mitad de 128 bits por separado
+__attribute__((target("avx2"))) inline uint64_t bitsAvx2(__m256i clase, uint8_t grupo) {
+    __m256i sinGrupo = _mm256_cmpeq_epi8(_mm256_and_si256(clase, _mm256_set1_epi8(char(grupo))), _mm256_setzero_si256());
+    return uint64_t(~uint32_t(_mm256_movemask_epi8(sinGrupo)));
+}
+__attribute__((target("avx2"))) void clasificarAvx2(const char* bloque, MascarasBloque& m) {
+    const __m256i alta = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(NIBBLE_ALTO)));
+    const __m256i baja = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(NIBBLE_BAJO)));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    m = {};
+    for (unsigned k = 0; k < 64; k += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bloque + k));
+        __m256i clase = _mm256_and_si256(_mm256_shuffle_epi8(alta, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)),
+                                         _mm256_shuffle_epi8(baja, _mm256_and_si256(v, nibble)));
+        m.digito |= bitsAvx2(clase, CC_DIGITO) << k;
+        m.punto |= bitsAvx2(clase, CC_PUNTO) << k;
+        m.letra |= bitsAvx2(clase, CC_LETRA) << k;
+        m.simple |= bitsAvx2(clase, CC_SIMPLE) << k;
+        m.valido |= bitsAvx2(clase, 0xFF) << k;
+    }
+}
+
+const ClasificadorCaracteres clasificadorSse = { "sse", clasificarSse };
+const ClasificadorCaracteres clasificadorAvx2 = { "avx2", clasificarAvx2 };
+#endif
+
+/* Elige el clasificador al ejecutar con el mismo criterio que seleccionarNucleos. La version
+"sse" usa pshufb, que es de SSSE3 y no de SSE2; si el procesador no lo tiene se usa la escalar */
+const ClasificadorCaracteres& seleccionarClasificador(const string& preferido) {
+#if USAR_SIMD_X86
+    bool hayAvx2 = __builtin_cpu_supports("avx2");
+    bool haySsse3 = __builtin_cpu_supports("ssse3");
+    if (preferido == "escalar") return clasificadorEscalar;
+    if (preferido == "sse") return haySsse3 ? clasificadorSse : clasificadorEscalar;
+    return hayAvx2 ? clasificadorAvx2 : haySsse3 ? clasificadorSse : clasificadorEscalar;
+#else
+    return clasificadorEscalar;
+#endif
+}
+
+// Clasificadores que soporta el procesador, empezando por el escalar
+vector<const ClasificadorCaracteres*> clasificadoresDisponibles() {
+    vector<const ClasificadorCaracteres*> clasificadores = { &clasificadorEscalar };
+#if USAR_SIMD_X86
+    if (__builtin_cpu_supports("ssse3")) clasificadores.push_back(&clasificadorSse);
+    if (__builtin_cpu_supports("avx2")) clasificadores.push_back(&clasificadorAvx2);
+#endif
+    return clasificadores;
+}
+
+/* Tokenizar la cadena entrante en una sola pasada byte por byte. Los numeros se validan y
+clasifican como enteros o flotantes al mismo tiempo; un simbolo no valido manda a errores(1)
+y un literal mal formado (por ejemplo 1.2.3) manda a errores(3) */
+void lexerEscalar(Contexto& ctx, string_view entrada) {
+    size_t i = 0;
+    while (i < entrada.size()) {
+        char c = entrada[i];
+        TipoToken tipo;
+        switch (c) {
+        case ' ':
+            i++;
+            continue;
+        case '+': tipo = TipoToken::Suma; break;
+        case '-': tipo = TipoToken::Resta; break;
+        case '*': tipo = TipoToken::Multiplicacion; break;
+        case '/': tipo = TipoToken::Division; break;
+        case '(': tipo = TipoToken::AbreParentesis; break;
+        case ')': tipo = TipoToken::CierraParentesis; break;
+        default:
+            if ((c >= '0' && c <= '9') || c == '.') {
+                bool flotante, valido;
+                size_t fin = escanearNumero(entrada, i, flotante, valido);
+                if (!valido) {
+                    ctx.posicionError = i;
+                    errores(ctx, 3); // Tipo de dato incorrecto
+                    return;
+                }
+                ctx.cadena.push_back({ TipoToken::Num, flotante, uint32_t(i), uint32_t(fin - i) });
+                i = fin;
+                continue;
+            }
+            if (esInicioIdentificador(c)) {
+                size_t fin = i + 1;
+                while (fin < entrada.size() && (esInicioIdentificador(entrada[fin]) || (entrada[fin] >= '0' && entrada[fin] <= '9'))) fin++;
+                ctx.cadena.push_back({ TipoToken::Id, false, uint32_t(i), uint32_t(fin - i) });
+                i = fin;
+                continue;
+            }
+            ctx.posicionError = i;
+            errores(ctx, 1); // Si encuentra un caracter no valido llama a la funcion errores
+            return;
+        }
+        ctx.cadena.push_back({ tipo, false, uint32_t(i), 1 });
+        i++;
+    }
+}
+
+// Tipo del token que empieza con cada caracter valido (los demas no inician tokens)
+constexpr array<TipoToken, 256> tablaTipoInicial() {
+    array<TipoToken, 256> tabla{};
+    for (int c = 0; c < 256; c++) {
+        uint8_t clase = claseCaracter((unsigned char)c);
+        tabla[c] = (clase & (CC_DIGITO | CC_PUNTO)) ? TipoToken::Num : TipoToken::Id;
+    }
+    tabla['+'] = TipoToken::Suma;
+    tabla['-'] = TipoToken::Resta;
+    tabla['*'] = TipoToken::Multiplicacion;
+    tabla['/'] = TipoToken::Division;
+    tabla['('] = TipoToken::AbreParentesis;
+    tabla[')'] = TipoToken::CierraParentesis;
+    return tabla;
+}
+constexpr array<TipoToken, 256> TIPO_INICIAL = tablaTipoInicial();
+
+/* Suma de 64 bits con acarreo de entrada y de salida, para que los rellenos de las mascaras
+sigan de un bloque al siguiente */
+inline uint64_t sumarConAcarreo(uint64_t a, uint64_t b, uint64_t& acarreo) {
+    uint64_t suma;
+    bool acarreo1 = __builtin_add_overflow(a, b, &suma);
+    bool acarreo2 = __builtin_add_overflow(suma, acarreo, &suma);
+    acarreo = acarreo1 | acarreo2;
+    return suma;
+}
+
+/* Tokeniza con mascaras de bits por bloques de 64 bytes. Las fronteras y la validez de los
+tokens salen de operaciones sobre las mascaras, sin revisar byte por byte:
+- un identificador empieza en una letra y sigue por letras y digitos: se rellena desde cada
+  letra hacia adelante dentro de su tramo alfanumerico con una suma, cuyo acarreo pasa al
+  siguiente bloque; los numeros son los digitos y puntos que no quedaron en un identificador;
+- igual, rellenando desde cada punto dentro de su numero, se sabe si un literal es flotante,
+  si tiene un segundo punto o si termina en punto;
+- los inicios y finales de tramo se obtienen comparando cada mascara con ella misma recorrida
+  un bit (y el ultimo bit del bloque anterior).
+Despues solo se visitan los bits de inicio y de fin de los tokens. Regresa falso sin dejar
+tokens si hay un caracter no valido o un literal mal formado; en ese caso lexerEscalar
+reporta el error igual que siempre */
+bool lexerMascaras(Contexto& ctx, string_view entrada, const ClasificadorCaracteres& clasificador) {
+    vector<Token>& cadena = ctx.cadena;
+    size_t inicial = cadena.size();
+    // Tokens de numero o identificador cuyo final aun no se conoce, en orden; a lo mas uno pasa de bloque
+    size_t abiertos[65];
+    size_t totalAbiertos = 0;
+    uint64_t acarreoId = 0, acarreoPunto = 0;
+    uint64_t previoNumero = 0, previoId = 0, previoPunto = 0, previoNumeroPunto = 0;
+    char relleno[64];
+    MascarasBloque m;
+
+    for (size_t base = 0; base < entrada.size(); base += 64) {
+        const char* bloque = entrada.data() + base;
+        if (entrada.size() - base < 64) {
+            // El ultimo bloque se completa con espacios, que no generan tokens
+            memset(relleno, ' ', sizeof(relleno));
+            memcpy(relleno, bloque, entrada.size() - base);
+            bloque = relleno;
+        }
+        clasificador.clasificar(bloque, m);
+
+        uint64_t alfanumerico = m.letra | m.digito;
+        uint64_t id = ((sumarConAcarreo(alfanumerico, m.letra, acarreoId) ^ alfanumerico) | m.letra) & alfanumerico;
+        uint64_t numero = (m.digito | m.punto) & ~id;
+        uint64_t despuesDePunto = ((sumarConAcarreo(numero, m.punto, acarreoPunto) ^ numero) | m.punto) & numero;
+
+        uint64_t inicioTramo = (numero & ~((numero << 1) | previoNumero)) | (id & ~((id << 1) | previoId));
+        uint64_t finNumero = ~numero & ((numero << 1) | previoNumero);
+        uint64_t fin = finNumero | (~id & ((id << 1) | previoId));
+        uint64_t flotante = finNumero & ((despuesDePunto << 1) | previoPunto);
+        uint64_t malFormado = (m.punto & ((despuesDePunto << 1) | previoPunto))       // Segundo punto
+                            | (~numero & (((numero & m.punto) << 1) | previoNumeroPunto)); // Termina en punto
+        if (~m.valido | malFormado) {
+            cadena.resize(inicial);
+            return false;
+        }
+        previoNumero = numero >> 63;
+        previoId = id >> 63;
+        previoPunto = despuesDePunto >> 63;
+        previoNumeroPunto = (numero & m.punto) >> 63;
+
+        for (uint64_t inicios = inicioTramo | m.simple; inicios; inicios &= inicios - 1) {
+            unsigned k = unsigned(__builtin_ctzll(inicios));
+            uint32_t pos = uint32_t(base + k);
+            abiertos[totalAbiertos] = cadena.size();
+            totalAbiertos += (inicioTramo >> k) & 1;
+            cadena.push_back({ TIPO_INICIAL[(unsigned char)entrada[pos]], false, pos, 1 });
+        }
+        // Cada final cierra el tramo abierto mas antiguo
+        size_t cerrados = 0;
+        for (; fin; fin &= fin - 1) {
+            unsigned k = unsigned(__builtin_ctzll(fin));
+            Token& token = cadena[abiertos[cerrados++]];
+            token.longitud = uint32_t(base + k - token.inicio);
+            token.flotante = (flotante >> k) & 1;
+        }
+        if (cerrados < totalAbiertos) abiertos[0] = abiertos[cerrados];
+        totalAbiertos -= cerrados;
+    }
+    // Un tramo que llega al final de un bloque completo no tuvo final
+    if (totalAbiertos > 0) {
+        if (previoNumeroPunto) {
+            cadena.resize(inicial);
+            return false;
+        }
+        Token& token = cadena[abiertos[0]];
+        token.longitud = uint32_t(entrada.size() - token.inicio);
+        token.flotante = previoPunto != 0;
+    }
+    return true;
+}
+
+// Si dos cadenas tokenizadas tienen los mismos tokens en las mismas posiciones
+bool mismosTokens(const vector<Token>& a, const vector<Token>& b) {
+    return a.size() == b.size() && equal(a.begin(), a.end(), b.begin(), [](const Token& x, const Token& y) {
+        return x.tipo == y.tipo && x.flotante == y.flotante && x.inicio == y.inicio && x.longitud == y.longitud;
+    });
+}
+
+// Clasificador que usa el lexer, main lo elige despues de leer --simd
+const ClasificadorCaracteres* clasificadorLexer = &clasificadorEscalar;
+
+/* Tokenizar la cadena entrante. Las entradas de al menos un bloque usan lexerMascaras; las
+cortas y las que tienen un error usan lexerEscalar, que produce exactamente los mismos tokens */
+void lexer(Contexto& ctx, string_view entrada) {
+    if (entrada.size() >= 64 && entrada.size() <= UINT32_MAX && lexerMascaras(ctx, entrada, *clasificadorLexer)) return;
+    lexerEscalar(ctx, entrada);
+}
+
+// Clase de cada tipo de token para la gramatica, en el mismo orden que TipoToken
+enum class ClaseToken : uint8_t { Operando, Aditivo, Multiplicativo, Abre, Cierra };
+constexpr array<ClaseToken, 8> CLASE_TOKEN = {
+    ClaseToken::Operando, ClaseToken::Aditivo, ClaseToken::Aditivo, ClaseToken::Multiplicativo,
+    ClaseToken::Multiplicativo, ClaseToken::Abre, ClaseToken::Cierra, ClaseToken::Operando
+};
+static_assert(CLASE_TOKEN[size_t(TipoToken::Resta)] == ClaseToken::Aditivo
+              && CLASE_TOKEN[size_t(TipoToken::Division)] == ClaseToken::Multiplicativo
+              && CLASE_TOKEN[size_t(TipoToken::CierraParentesis)] == ClaseToken::Cierra
+              && CLASE_TOKEN[size_t(TipoToken::Id)] == ClaseToken::Operando,
+              "CLASE_TOKEN debe seguir el orden de TipoToken");
+
+constexpr ClaseToken claseDe(TipoToken tipo) {
+    return CLASE_TOKEN[size_t(tipo)];
+}
+
+// Operadores de cada nivel de la gramatica
+bool esAditivo(const Token& token) {
+    return claseDe(token.tipo) == ClaseToken::Aditivo;
+}
+
+bool esMultiplicativo(const Token& token) {
+    return claseDe(token.tipo) == ClaseToken::Multiplicativo;
+}
+
+/* Revision de ambiguedad en una sola pasada: cada token se procesa una vez en O(1) recordando
+solo las clases de los dos tokens anteriores. Las reglas son las de la revision original, que
+volvia a recorrer la cadena despues de cada '(':
+- un operador no puede tener a dos posiciones otro de su misma clase (1+2+3, 2*3/4);
+- el primer operador seguido de '(' corta la regla anterior, y desde ahi solo se revisa que
+  ningun ')' vaya seguido de un operador de la clase de ese operador.
+El parser la alimenta conforme consume tokens, asi no hace falta un recorrido previo */
+class ValidadorAmbiguedad {
+public:
+    // Con 'activo' en falso no revisa nada, para analizar cadenas que se saben ambiguas
+    explicit ValidadorAmbiguedad(const vector<Token>& cadena, bool activo = true)
+        : cadena(cadena), activo(activo) {}
+
+    // Procesa los tokens pendientes hasta la posicion 'hasta' (sin incluirla)
+    void alcanzar(size_t hasta) {
+        if (!activo) return;
+        for (; validados < hasta; validados++) avanzar(claseDe(cadena[validados].tipo));
+    }
+
+    bool ambigua() const { return ambiguo; }
+
+private:
+    static constexpr bool esOperador(ClaseToken clase) {
+        return clase == ClaseToken::Aditivo || clase == ClaseToken::Multiplicativo;
+    }
+
+    void avanzar(ClaseToken clase) {
+        if (corte == ClaseToken::Operando) {
+            if (esOperador(hace2) && clase == hace2) ambiguo = true;
+            else if (esOperador(hace1) && clase == ClaseToken::Abre) {
+                corte = hace1;
+                despuesDelCorte = false;
+            }
+        }
+        else {
+            // El operador del corte todavia revisa el token a dos posiciones, el que sigue al '('
+            if ((!despuesDelCorte || hace1 == ClaseToken::Cierra) && clase == corte) ambiguo = true;
+            despuesDelCorte = true;
+        }
+        hace2 = hace1;
+        hace1 = clase;
+    }
+
+    const vector<Token>& cadena;
+    bool activo;
+    size_t validados = 0;
+    ClaseToken hace1 = ClaseToken::Operando, hace2 = ClaseToken::Operando; // Clases de los dos tokens anteriores
+    ClaseToken corte = ClaseToken::Operando; // Clase del primer operador seguido de '(', Operando si aun no hay
+    bool despuesDelCorte = false;
+    bool ambiguo = false;
+};
+
+// Si la cadena tokenizada es ambigua manda a error. El parser ya lo revisa, esta se usa para medirla sola
+void encontrarAmbiguedad(Contexto& ctx) {
+    ValidadorAmbiguedad validador(ctx.cadena);
+    validador.alcanzar(ctx.cadena.size());
+    if (validador.ambigua()) errores(ctx, 2);
+}
+
+/* Error de sintaxis del parser. Antes de reportarlo termina de revisar el resto de la cadena:
+si ademas es ambigua se reporta el error 2, como cuando la ambiguedad se revisaba antes */
+void errorSintaxis(Contexto& ctx, ValidadorAmbiguedad& validador) {
+    validador.alcanzar(ctx.cadena.size());
+    errores(ctx, validador.ambigua() ? 2 : 5);
+}
+
+// Al terminar el analisis revisa que no sobren tokens y que la cadena no sea ambigua
+void terminarAnalisis(Contexto& ctx, ValidadorAmbiguedad& validador, size_t cursor) {
+    if (ctx.error) return;
+    if (cursor < ctx.cadena.size()) {
+        errorSintaxis(ctx, validador); // Sobran tokens, por ejemplo un ')' sin abrir
+        return;
+    }
+    validador.alcanzar(cursor);
+    if (validador.ambigua()) errores(ctx, 2);
+}
+
+/* Analizador descendente guiado por la gramatica. La cadena tokenizada se consume a traves
+de un cursor, de modo que cada token se visita una sola vez (O(n)), y en lugar de una funcion
+recursiva por regla se usa una pila de marcos en el heap: cada '(' y cada - unario agregan
+un marco y no una llamada, asi la profundidad del anidamiento solo esta limitada por la memoria.
+Se construyen los mismos nodos del arbol ternario que en las reglas de produccion:
+<E> → <E> + <T> | <E> - <T> | <T>,  <T> → <T> * <T> | <T> / <T> | <U>,  <U> → - <U> | ( <E> ) | num | id
+Las operaciones de <E> y <T> se agrupan por la izquierda. La revision de ambiguedad avanza
+junto con el cursor (ver ValidadorAmbiguedad) */
+
+// Regresa el token en la posicion del cursor o nullptr si ya se consumio todo
+const Token* tokenActual(const Contexto& ctx, size_t cursor) {
+    return cursor < ctx.cadena.size() ? &ctx.cadena[cursor] : nullptr;
+}
+
+// Función para construir el árbol a partir de la cadena tokenizada
+/* Se aplican las reglas de produccion de la gramatica en una sola pasada sobre la cadena.
+Con 'validar' en falso no se revisa la ambiguedad, para construir el arbol de cadenas ya validadas */
+void parser(Contexto& ctx, bool validar = true) {
+    ArbolTernario& arbol = ctx.arbol;
+    vector<MarcoParser>& pila = ctx.pilaParser;
+    ValidadorAmbiguedad validador(ctx.cadena, validar);
+    size_t cursor = 0;
+    pila.clear();
+    pila.push_back({ Simbolo::E, 0, &arbol.raiz, nullptr, nullptr, nullptr, nullptr });
+
+    while (!pila.empty() && !ctx.error) {
+        MarcoParser& m = pila.back(); // Solo es valido hasta el siguiente push_back
+        const Token* token = tokenActual(ctx, cursor);
+        validador.alcanzar(cursor);
+        if (validador.ambigua()) break; // El resultado ya es el error 2, terminarAnalisis lo reporta
+
+        if (m.regla == Simbolo::E) {
+            if (m.paso == 0) {
+                arbol.insertar(Simbolo::E, *m.destino, m.padre);
+                m.actual = *m.destino;
+                arbol.insertar(Simbolo::Nulo, m.actual->izquierdo, m.actual);
+                m.paso = 1;
+                pila.push_back({ Simbolo::T, 0, &m.actual->medio, m.actual, nullptr, nullptr, nullptr });
+            }
+            else if (m.paso == 1) {
+                arbol.insertar(Simbolo::Nulo, m.actual->derecho, m.actual);
+                m.paso = 2;
+            }
+            else if (token && esAditivo(*token)) {
+                // El <E> construido hasta ahora pasa a ser el hijo izquierdo del nuevo <E>
+                cursor++;
+                Nodo* nuevo = nullptr;
+                arbol.insertar(Simbolo::E, nuevo, m.padre);
+                nuevo->izquierdo = m.actual;
+                m.actual->padre = nuevo;
+                arbol.insertar(simboloDeToken(token->tipo), nuevo->medio, nuevo);
+                m.actual = nuevo;
+                pila.push_back({ Simbolo::T, 0, &nuevo->derecho, nuevo, nullptr, nullptr, nullptr });
+            }
+            else {
+                *m.destino = m.actual;
+                pila.pop_back();
+            }
+        }
+        else if (m.regla == Simbolo::T) {
+            if (m.paso == 0) {
+                arbol.insertar(Simbolo::T, *m.destino, m.padre);
+                m.actual = *m.destino;
+                arbol.insertar(Simbolo::Nulo, m.actual->izquierdo, m.actual);
+                m.paso = 1;
+                pila.push_back({ Simbolo::U, 0, &m.actual->medio, m.actual, nullptr, nullptr, nullptr });
+            }
+            else if (m.paso == 1) {
+                arbol.insertar(Simbolo::Nulo, m.actual->derecho, m.actual);
+                m.paso = 2;
+            }
+            else if (m.paso == 3) {
+                // Termino el operando derecho de la operacion en curso
+                arbol.insertar(Simbolo::Nulo, m.derecho->derecho, m.derecho);
+                m.nuevo->derecho = m.derecho;
+                m.actual = m.nuevo;
+                m.paso = 2;
+            }
+            else if (token && esMultiplicativo(*token)) {
+                // El <T> construido hasta ahora pasa a ser el hijo izquierdo del nuevo <T>
+                cursor++;
+                Nodo* nuevo = nullptr;
+                arbol.insertar(Simbolo::T, nuevo, m.padre);
+                nuevo->izquierdo = m.actual;
+                m.actual->padre = nuevo;
+                arbol.insertar(simboloDeToken(token->tipo), nuevo->medio, nuevo);
+
+                Nodo* derecho = nullptr;
+                arbol.insertar(Simbolo::T, derecho, nuevo);
+                arbol.insertar(Simbolo::Nulo, derecho->izquierdo, derecho);
+                m.nuevo = nuevo;
+                m.derecho = derecho;
+                m.paso = 3;
+                pila.push_back({ Simbolo::U, 0, &derecho->medio, derecho, nullptr, nullptr, nullptr });
+            }
+            else {
+                *m.destino = m.actual;
+                pila.pop_back();
+            }
+        }
+        else if (m.paso == 0) { // <U> → - <U> | ( <E> ) | num | id
+            arbol.insertar(Simbolo::U, *m.destino, m.padre);
+            Nodo* actual = *m.destino;
+            m.actual = actual;
+
+            if (token == nullptr) {
+                errorSintaxis(ctx, validador); // Falta un operando al final de la cadena
+            }
+            else if (token->tipo == TipoToken::Resta) {
+                cursor++;
+                arbol.insertar(Simbolo::Resta, actual->izquierdo, actual);
+                m.paso = 1;
+                pila.push_back({ Simbolo::U, 0, &actual->medio, actual, nullptr, nullptr, nullptr });
+            }
+            else if (token->tipo == TipoToken::AbreParentesis) {
+                cursor++;
+                arbol.insertar(Simbolo::AbreParentesis, actual->izquierdo, actual);
+                m.paso = 2;
+                pila.push_back({ Simbolo::E, 0, &actual->medio, actual, nullptr, nullptr, nullptr });
+            }
+            else if (token->tipo == TipoToken::Num || token->tipo == TipoToken::Id) {
+                cursor++;
+                arbol.insertar(Simbolo::Nulo, actual->izquierdo, actual);
+                arbol.insertar(simboloDeToken(token->tipo), actual->medio, actual);
+                arbol.insertar(Simbolo::Nulo, actual->derecho, actual);
+
+                Nodo* num = actual->medio;
+                arbol.insertar(Simbolo::Nulo, num->izquierdo, num);
+                arbol.insertar(Simbolo::Literal, num->medio, num, ctx.texto(*token));
+                arbol.insertar(Simbolo::Nulo, num->derecho, num);
+                pila.pop_back();
+            }
+            else {
+                errorSintaxis(ctx, validador); // Falta un operando
+            }
+        }
+        else if (m.paso == 1) { // Termino el <U> despues del - unario
+            arbol.insertar(Simbolo::Nulo, m.actual->derecho, m.actual);
+            pila.pop_back();
+        }
+        else { // Termino el <E> entre parentesis
+            if (token == nullptr || token->tipo != TipoToken::CierraParentesis) {
+                errorSintaxis(ctx, validador); // Parentesis sin cerrar
+                break;
+            }
+            cursor++;
+            arbol.insertar(Simbolo::CierraParentesis, m.actual->derecho, m.actual);
+            pila.pop_back();
+        }
+    }
+    terminarAnalisis(ctx, validador, cursor);
+}
+
+// Secciones de la salida de cada expresion. Los errores y las estadisticas se imprimen siempre
+enum SeccionSalida : uint8_t {
+    SALIDA_TOKENS = 1,    // Cadena tokenizada
+    SALIDA_IR = 2,        // Lenguaje intermedio y reporte de la optimizacion
+    SALIDA_TRAZA = 4,     // Sustitucion de valores paso a paso o pasos de la maquina virtual
+    SALIDA_RESULTADO = 8, // Linea "Resultado = ..."
+    SALIDA_TODO = 15
+};
+
+// Opciones de linea de comandos que afectan a todos los modos
+struct Opciones {
+    bool optimizar = false; // --optimizar: aplica los pases sobre el lenguaje intermedio
+    bool maquinaVirtual = false; // --vm: evalua con la maquina virtual en lugar de la sustitucion paso a paso
+    bool traza = false;     // --traza: la maquina virtual imprime cada paso
+    size_t repeticiones = 0; // --repetir N: vuelve a evaluar el codigo de bytes N veces y mide el tiempo
+    size_t hilos = 1;       // --hilos N: hilos del modo por lotes (0 usa todos los nucleos)
+    string simd;            // --simd escalar|sse|avx2: fuerza los nucleos del modo --columnas y el clasificador del lexer
+    bool estadisticas = false; // --stats: tiempos, tamaños y memoria de cada expresion en JSON
+    size_t cacheMegas = 0;  // --cache MB: presupuesto de la cache de programas (0 la desactiva)
+    bool cacheParametrica = false; // --cache-parametrica: los literales no forman parte de la clave
+    bool arbol = false;     // --arbol: construye siempre el arbol de parseo y genera el codigo desde el
+    size_t hilosEvaluacion = 0; // --paralelo N: evalua cada expresion grande con N hilos (0 usa todos los nucleos)
+    size_t umbral = 4096;   // --umbral N: instrucciones minimas por tarea de la evaluacion paralela
+    bool reutilizar = true; // --sin-reutilizar: con --optimizar cada instruccion conserva su propio temporal
+    uint8_t salida = SALIDA_TODO; // --salida tokens,ir,traza,resultado: secciones que se imprimen de cada expresion
+};
+Opciones opciones;
+
+/* Convierte una lista de nombres separados por comas (por ejemplo "ir,resultado") en la union
+de sus bits. Regresa falso si algun nombre no existe o la lista queda vacia */
+template <size_t N>
+bool leerBanderas(string_view lista, const pair<string_view, uint32_t> (&nombres)[N], uint32_t& banderas) {
+    banderas = 0;
+    while (!lista.empty()) {
+        size_t coma = lista.find(',');
+        string_view nombre = lista.substr(0, coma);
+        auto it = find_if(begin(nombres), end(nombres), [&](const auto& n) { return n.first == nombre; });
+        if (it == end(nombres)) return false;
+        banderas |= it->second;
+        lista = coma == string_view::npos ? string_view() : lista.substr(coma + 1);
+    }
+    return banderas != 0;
+}
+
+// Secciones de --salida
+bool leerSecciones(string_view lista, uint8_t& secciones) {
+    static const pair<string_view, uint32_t> nombres[] = {
+        { "tokens", SALIDA_TOKENS }, { "ir", SALIDA_IR }, { "traza", SALIDA_TRAZA }, { "resultado", SALIDA_RESULTADO },
+    };
+    uint32_t banderas;
+    if (!leerBanderas(lista, nombres, banderas)) return false;
+    secciones = uint8_t(banderas);
+    return true;
+}
+
+// Lee el valor numerico de una opcion. Regresa falso si el texto no es un numero completo
+template <typename T>
+bool leerNumero(string_view texto, T& valor) {
+    auto leido = from_chars(texto.data(), texto.data() + texto.size(), valor);
+    return leido.ec == errc() && leido.ptr == texto.data() + texto.size();
+}
+
+// Prototipos de la impresion y la sustitucion de valores especificos
+void imprimirPrograma(SalidaBuffer&, const Programa&);
+bool seParticiona(const Programa&);
+void resolverOperacion(Contexto&);
+
+/* Genera el codigo del arbol en postorden y regresa el temporal con su resultado. El recorrido
+usa una pila de nodos pendientes y otra con los temporales de los subarboles ya generados, sin
+recursion. 'hoja' cuenta los literales visitados: aparecen en el mismo orden que en la cadena
+y sus temporales t[0..n-1] ya fueron cargados. Durante la generacion el destino de cada
+instruccion coincide con su posicion, por eso el tipo de un temporal se lee directamente de
+instrucciones */
+uint32_t generarSubarbol(Programa& prog, const Nodo* raiz, uint32_t& hoja, vector<PasoRecorrido>& pila, vector<uint32_t>& temporales) {
+    pila.clear();
+    temporales.clear();
+    pila.push_back({ raiz, 0 });
+    while (!pila.empty()) {
+        PasoRecorrido& paso = pila.back();
+        const Nodo* nodo = paso.nodo;
+        switch (nodo->simbolo) {
+        case Simbolo::E:
+        case Simbolo::T:
+            if (nodo->medio->simbolo == Simbolo::E || nodo->medio->simbolo == Simbolo::T || nodo->medio->simbolo == Simbolo::U) {
+                paso = { nodo->medio, 0 }; // <E> → <T> o <T> → <U>
+            }
+            else if (paso.etapa == 0) {
+                paso.etapa = 1;
+                pila.push_back({ nodo->izquierdo, 0 });
+            }
+            else if (paso.etapa == 1) {
+                paso.etapa = 2;
+                pila.push_back({ nodo->derecho, 0 });
+            }
+            else {
+                pila.pop_back();
+                uint32_t derecho = temporales.back();
+                temporales.pop_back();
+                uint32_t izquierdo = temporales.back();
+                CodigoOp op = CodigoOp::Suma;
+                switch (nodo->medio->simbolo) {
+                case Simbolo::Resta: op = CodigoOp::Resta; break;
+                case Simbolo::Multiplicacion: op = CodigoOp::Multiplicacion; break;
+                case Simbolo::Division: op = CodigoOp::Division; break;
+                default: break;
+                }
+                TipoDato tipo = (prog.instrucciones[izquierdo].tipo == TipoDato::Flotante || prog.instrucciones[derecho].tipo == TipoDato::Flotante)
+                    ? TipoDato::Flotante : TipoDato::Entero;
+                temporales.back() = prog.emitir(op, tipo, izquierdo, derecho);
+            }
+            break;
+        case Simbolo::U:
+            if (nodo->izquierdo->simbolo == Simbolo::Resta) {
+                if (paso.etapa == 0) {
+                    paso.etapa = 1;
+                    pila.push_back({ nodo->medio, 0 });
+                }
+                else {
+                    pila.pop_back();
+                    uint32_t operando = temporales.back();
+                    temporales.back() = prog.emitir(CodigoOp::Negacion, prog.instrucciones[operando].tipo, operando);
+                }
+            }
+            else if (nodo->izquierdo->simbolo == Simbolo::AbreParentesis) {
+                paso = { nodo->medio, 0 };
+            }
+            else {
+                pila.pop_back();
+                temporales.push_back(hoja++); // <U> → num | id
+            }
+            break;
+        default:
+            pila.pop_back();
+            temporales.push_back(hoja++);
+        }
+    }
+    return temporales.back();
+}
+
+constexpr uint32_t SIN_TEXTO = UINT32_MAX; // Valor calculado al compilar, sin literal en la entrada
+
+/* Vuelve a llenar las tablas de literales y variables de un programa tomado de la cache con
+el texto de la entrada actual. Sin 'hojas' las tablas salen en el mismo orden en que las llena
+generarLenguaje y los valores se convierten del texto. Con 'hojas' los valores ya vienen en el
+programa (optimizado, con la tabla compactada) y hojas[i] dice que literal de la cadena es el
+valor i, o SIN_TEXTO si es una constante del plegado */
+void enlazarHojas(Contexto& ctx, const vector<uint32_t>& hojas) {
+    Programa& prog = ctx.programa;
+    bool convertir = hojas.empty();
+    prog.literales.clear();
+    if (convertir) prog.valores.clear();
+    prog.variables.clear();
+    for (const Token& token : ctx.cadena) {
+        if (token.tipo == TipoToken::Id) {
+            string_view nombre = ctx.texto(token);
+            if (find(prog.variables.begin(), prog.variables.end(), nombre) == prog.variables.end()) prog.variables.push_back(nombre);
+        }
+        else if (token.tipo == TipoToken::Num) {
+            string_view texto = ctx.texto(token);
+            prog.literales.push_back(texto);
+            if (!convertir) continue;
+            float valor = 0;
+            from_chars(texto.data(), texto.data() + texto.size(), valor);
+            prog.valores.push_back(valor);
+        }
+    }
+    if (convertir) return;
+    // Los textos de la cadena quedan al inicio mientras se acomodan los de la tabla despues de ellos
+    size_t enCadena = prog.literales.size();
+    prog.literales.resize(enCadena + hojas.size());
+    for (size_t i = 0; i < hojas.size(); i++) {
+        prog.literales[enCadena + i] = hojas[i] == SIN_TEXTO ? string_view() : prog.literales[hojas[i]];
+    }
+    prog.literales.erase(prog.literales.begin(), prog.literales.begin() + enCadena);
+}
+
+/* Guarda los valores de las hojas en los primeros temporales, con el tipo detectado por el lexer.
+Las variables se leen como flotantes y cada nombre distinto ocupa una entrada de la tabla */
+void cargarHojas(Contexto& ctx) {
+    Programa& prog = ctx.programa;
+    for (const Token& token : ctx.cadena) {
+        if (token.tipo == TipoToken::Id) {
+            string_view nombre = ctx.texto(token);
+            size_t indice = find(prog.variables.begin(), prog.variables.end(), nombre) - prog.variables.begin();
+            if (indice == prog.variables.size()) prog.variables.push_back(nombre);
+            prog.emitir(CodigoOp::Variable, TipoDato::Flotante, uint32_t(indice));
+            continue;
+        }
+        if (token.tipo != TipoToken::Num) continue;
+        string_view texto = ctx.texto(token);
+        float valor = 0;
+        from_chars(texto.data(), texto.data() + texto.size(), valor);
+        prog.emitir(CodigoOp::Cargar, token.flotante ? TipoDato::Flotante : TipoDato::Entero, uint32_t(prog.literales.size()));
+        prog.literales.push_back(texto);
+        prog.valores.push_back(valor);
+    }
+}
+
+// Genera el lenguaje intermedio (Representacion interna)
+void generarLenguaje(Contexto& ctx) {
+    Programa& prog = ctx.programa;
+    prog.limpiar();
+    cargarHojas(ctx);
 
-    cout << "Sustitucion de Valores especificos\n";
     // Generar las operaciones desde las hojas hacia la raíz
-    while (operaciones.size() > 1) {
-        size_t indice = operaciones[0].find_first_of('[');
-        int paso = operaciones[0][indice + 1] - '0';
-        if (paso < ultimos.size()) {
-            // Si el paso es solo guardar el numero hace la conversion de tipos
-            string val = ultimos[paso]->valor;
-            size_t punto = val.find_first_of('.');
-            if (punto == string::npos) {
-                size_t igual = operaciones[0].find_first_of('=');
-                igual += 2;
-                string temp = "";
-                for (int i = igual; i < operaciones[0].size(); i++) {
-                    temp += operaciones[0][i];
+    uint32_t hoja = 0;
+    uint32_t resultado = generarSubarbol(prog, ctx.arbol.raiz, hoja, ctx.pilaRecorrido, ctx.pilaTemporales);
+    prog.resultado = prog.emitir(CodigoOp::Copia, prog.instrucciones[resultado].tipo, resultado);
+}
+
+/* Analiza la cadena y genera el lenguaje intermedio en la misma pasada, sin construir el
+arbol ternario. Sigue las mismas reglas y reporta los mismos errores que parser, y como este
+termina cada operando antes de su operacion, las instrucciones salen en el mismo orden que
+las del recorrido en postorden de generarLenguaje. El arbol se construye despues solo si se
+quiere ver (ver asegurarArbol) */
+void traducirSinArbol(Contexto& ctx) {
+    Programa& prog = ctx.programa;
+    vector<MarcoTraduccion>& pila = ctx.pilaTraduccion;
+    vector<uint32_t>& temporales = ctx.pilaTemporales;
+    prog.limpiar();
+    cargarHojas(ctx);
+    pila.clear();
+    temporales.clear();
+    ValidadorAmbiguedad validador(ctx.cadena);
+    size_t cursor = 0;
+    uint32_t hoja = 0;
+
+    // Aplica el operador pendiente a los dos ultimos temporales
+    auto combinar = [&](TipoToken operador) {
+        uint32_t derecho = temporales.back();
+        temporales.pop_back();
+        uint32_t izquierdo = temporales.back();
+        CodigoOp op = operador == TipoToken::Suma ? CodigoOp::Suma
+                    : operador == TipoToken::Resta ? CodigoOp::Resta
+                    : operador == TipoToken::Multiplicacion ? CodigoOp::Multiplicacion : CodigoOp::Division;
+        TipoDato tipo = (prog.instrucciones[izquierdo].tipo == TipoDato::Flotante || prog.instrucciones[derecho].tipo == TipoDato::Flotante)
+            ? TipoDato::Flotante : TipoDato::Entero;
+        temporales.back() = prog.emitir(op, tipo, izquierdo, derecho);
+    };
+
+    pila.push_back({ Simbolo::E, 0, TipoToken::Suma });
+    while (!pila.empty() && !ctx.error) {
+        MarcoTraduccion& m = pila.back(); // Solo es valido hasta el siguiente push_back
+        const Token* token = tokenActual(ctx, cursor);
+        validador.alcanzar(cursor);
+        if (validador.ambigua()) break; // El resultado ya es el error 2, terminarAnalisis lo reporta
+
+        if (m.regla == Simbolo::E || m.regla == Simbolo::T) {
+            // <E> → <E> + <T> | <E> - <T> | <T>,  <T> → <T> * <T> | <T> / <T> | <U>
+            Simbolo operando = m.regla == Simbolo::E ? Simbolo::T : Simbolo::U;
+            if (m.paso == 0) {
+                m.paso = 1;
+                pila.push_back({ operando, 0, TipoToken::Suma });
+                continue;
+            }
+            if (m.paso == 2) combinar(m.operador);
+            if (token && (m.regla == Simbolo::E ? esAditivo(*token) : esMultiplicativo(*token))) {
+                cursor++;
+                m.operador = token->tipo;
+                m.paso = 2;
+                pila.push_back({ operando, 0, TipoToken::Suma });
+            }
+            else {
+                pila.pop_back();
+            }
+        }
+        else if (m.paso == 0) { // <U> → - <U> | ( <E> ) | num | id
+            if (token == nullptr) {
+                errorSintaxis(ctx, validador); // Falta un operando al final de la cadena
+            }
+            else if (token->tipo == TipoToken::Resta) {
+                cursor++;
+                m.paso = 1;
+                pila.push_back({ Simbolo::U, 0, TipoToken::Suma });
+            }
+            else if (token->tipo == TipoToken::AbreParentesis) {
+                cursor++;
+                m.paso = 2;
+                pila.push_back({ Simbolo::E, 0, TipoToken::Suma });
+            }
+            else if (token->tipo == TipoToken::Num || token->tipo == TipoToken::Id) {
+                cursor++;
+                temporales.push_back(hoja++);
+                pila.pop_back();
+            }
+            else {
+                errorSintaxis(ctx, validador); // Falta un operando
+            }
+        }
+        else if (m.paso == 1) { // Termino el <U> despues del - unario
+            uint32_t operando = temporales.back();
+            temporales.back() = prog.emitir(CodigoOp::Negacion, prog.instrucciones[operando].tipo, operando);
+            pila.pop_back();
+        }
+        else { // Termino el <E> entre parentesis
+            if (token == nullptr || token->tipo != TipoToken::CierraParentesis) {
+                errorSintaxis(ctx, validador); // Parentesis sin cerrar
+                break;
+            }
+            cursor++;
+            pila.pop_back();
+        }
+    }
+    terminarAnalisis(ctx, validador, cursor);
+    if (ctx.error) return;
+    uint32_t resultado = temporales.back();
+    prog.resultado = prog.emitir(CodigoOp::Copia, prog.instrucciones[resultado].tipo, resultado);
+}
+
+// Construye el arbol ternario si la expresion se tradujo sin el, para verlo o exportarlo
+void asegurarArbol(Contexto& ctx) {
+    if (ctx.arbol.raiz == nullptr && !ctx.cadena.empty()) parser(ctx, false);
+}
+
+// Imprime el lenguaje intermedio en texto, una instruccion por linea
+void imprimirPrograma(SalidaBuffer& salida, const Programa& prog) {
+    salida.texto("Representacion Interna\n");
+    for (const Instruccion& ins : prog.instrucciones) {
+        salida.temporal(ins.destino).texto(" = ");
+        switch (ins.op) {
+        case CodigoOp::Cargar:
+            // Las constantes plegadas no tienen texto en la entrada, se imprime su valor
+            if (prog.literales[ins.a].empty()) salida.flotante(prog.valores[ins.a]);
+            else salida.texto(prog.literales[ins.a]);
+            break;
+        case CodigoOp::Variable:
+            salida.texto(prog.variables[ins.a]);
+            break;
+        case CodigoOp::Negacion:
+            salida.texto("- ").temporal(ins.a);
+            break;
+        case CodigoOp::Copia:
+            salida.temporal(ins.a);
+            break;
+        default:
+            salida.temporal(ins.a).caracter(' ').texto(simboloOperacion(ins.op)).caracter(' ').temporal(ins.b);
+            break;
+        }
+        salida.caracter('\n');
+    }
+    salida.caracter('\n');
+}
+
+// Definida junto con la evaluacion paralela
+int evaluarSecuencial(const Programa&, vector<float>&, const float*);
+
+// Texto de la conversion de tipos de una instruccion
+inline const char* textoConversion(const Instruccion& ins) {
+    return ins.tipo == TipoDato::Flotante ? "to_float( " : "to_int( ";
+}
+
+/* Genera el lenguaje intermedio (Sustitucion de valores). Sin la seccion de traza (--salida)
+no se imprime cada paso y el programa se evalua de corrido */
+void resolverOperacion(Contexto& ctx) {
+    const Programa& prog = ctx.programa;
+    SalidaBuffer& salida = *ctx.salida;
+    vector<float> t(prog.temporales);
+
+    if (!(opciones.salida & SALIDA_TRAZA)) {
+        if (!prog.variables.empty()) {
+            // La sustitucion paso a paso no tiene valores para las variables
+            ctx.detalleError = string(prog.variables[0]);
+            errores(ctx, 6);
+            return;
+        }
+        if (int error = evaluarSecuencial(prog, t, nullptr)) {
+            errores(ctx, error);
+            return;
+        }
+        ctx.resultado = t[prog.resultado];
+        if (opciones.salida & SALIDA_RESULTADO) {
+            salida.texto("Resultado = ").texto(textoConversion(prog.instrucciones.back())).flotante(ctx.resultado).texto(" )\n");
+        }
+        return;
+    }
+
+    salida.texto("Sustitucion de Valores especificos\n");
+    for (const Instruccion& ins : prog.instrucciones) {
+        salida.temporal(ins.destino).texto(" = ");
+        switch (ins.op) {
+        case CodigoOp::Cargar:
+            // Si el paso es solo guardar el numero hace la conversion de tipos
+            t[ins.destino] = prog.valores[ins.a];
+            salida.texto(textoConversion(ins));
+            if (prog.literales[ins.a].empty()) salida.flotante(prog.valores[ins.a]);
+            else salida.texto(prog.literales[ins.a]);
+            salida.texto(" )\n");
+            break;
+        case CodigoOp::Variable:
+            // La sustitucion paso a paso no tiene valores para las variables
+            salida.texto(prog.variables[ins.a]).caracter('\n');
+            ctx.detalleError = string(prog.variables[ins.a]);
+            errores(ctx, 6);
+            return;
+        case CodigoOp::Negacion:
+            salida.texto("- ").flotante(t[ins.a]).caracter('\n');
+            t[ins.destino] = -t[ins.a];
+            break;
+        case CodigoOp::Copia:
+            // Para el ultimo paso solo manda el resultado a raiz
+            t[ins.destino] = t[ins.a];
+            salida.texto(textoConversion(ins)).flotante(t[ins.destino]).texto(" )\n");
+            break;
+        default:
+            // Si el paso contiene una operacion la realiza
+            salida.flotante(t[ins.a]).caracter(' ').texto(simboloOperacion(ins.op)).caracter(' ').flotante(t[ins.b]).caracter('\n');
+            if (ins.op == CodigoOp::Division && t[ins.b] == 0) {
+                errores(ctx, 4);
+                return;
+            }
+            t[ins.destino] = aplicarOperacion(ins.op, t[ins.a], t[ins.b]);
+            break;
+        }
+    }
+
+    // Si la optimizacion quito la copia final se muestra la conversion del resultado aparte
+    CodigoOp ultima = prog.instrucciones.back().op;
+    if (ultima != CodigoOp::Copia && ultima != CodigoOp::Cargar && (opciones.salida & SALIDA_RESULTADO)) {
+        salida.texto("Resultado = ").texto(textoConversion(prog.instrucciones.back())).flotante(t[prog.resultado]).texto(" )\n");
+    }
+    ctx.resultado = t[prog.resultado];
+}
+
+/* Pases de optimizacion sobre el lenguaje intermedio. Todos suponen que cada temporal se
+asigna una sola vez, como lo deja generarLenguaje */
+
+// Evalua en tiempo de compilacion las operaciones cuyos operandos son constantes
+size_t plegarConstantes(Programa& prog) {
+    size_t cambios = 0;
+    vector<char> esConstante(prog.temporales, 0);
+    vector<float> valor(prog.temporales, 0);
+
+    for (Instruccion& ins : prog.instrucciones) {
+        bool plegable = false;
+        float resultado = 0;
+        switch (ins.op) {
+        case CodigoOp::Cargar:
+            esConstante[ins.destino] = 1;
+            valor[ins.destino] = prog.valores[ins.a];
+            continue;
+        case CodigoOp::Variable:
+            continue;
+        case CodigoOp::Negacion:
+        case CodigoOp::Copia:
+            if (esConstante[ins.a]) {
+                plegable = true;
+                resultado = ins.op == CodigoOp::Negacion ? -valor[ins.a] : valor[ins.a];
+            }
+            break;
+        default:
+            // La division entre 0 no se pliega para que se reporte al evaluar
+            if (esConstante[ins.a] && esConstante[ins.b] && !(ins.op == CodigoOp::Division && valor[ins.b] == 0)) {
+                plegable = true;
+                resultado = aplicarOperacion(ins.op, valor[ins.a], valor[ins.b]);
+            }
+            break;
+        }
+        if (plegable) {
+            ins.op = CodigoOp::Cargar;
+            ins.a = prog.agregarConstante(resultado);
+            ins.b = 0;
+            esConstante[ins.destino] = 1;
+            valor[ins.destino] = resultado;
+            cambios++;
+        }
+    }
+    return cambios;
+}
+
+/* Numeracion de valores: dos instrucciones con la misma operacion sobre los mismos valores
+(o la misma constante) calculan lo mismo, la segunda se reemplaza por una copia de la primera */
+size_t eliminarSubexpresionesComunes(Programa& prog) {
+    size_t cambios = 0;
+    vector<uint32_t> numero(prog.temporales);
+    map<tuple<int, int, uint32_t, uint32_t>, uint32_t> vistos;
+
+    for (Instruccion& ins : prog.instrucciones) {
+        if (ins.op == CodigoOp::Copia) {
+            numero[ins.destino] = numero[ins.a];
+            continue;
+        }
+        tuple<int, int, uint32_t, uint32_t> clave;
+        if (ins.op == CodigoOp::Cargar) {
+            uint32_t bits;
+            memcpy(&bits, &prog.valores[ins.a], sizeof(bits));
+            clave = make_tuple(int(ins.op), int(ins.tipo), bits, 0u);
+        }
+        else if (ins.op == CodigoOp::Variable) {
+            clave = make_tuple(int(ins.op), int(ins.tipo), ins.a, 0u);
+        }
+        else {
+            uint32_t a = numero[ins.a];
+            uint32_t b = esBinaria(ins.op) ? numero[ins.b] : 0;
+            // La suma y la multiplicacion son conmutativas
+            if ((ins.op == CodigoOp::Suma || ins.op == CodigoOp::Multiplicacion) && b < a) swap(a, b);
+            clave = make_tuple(int(ins.op), int(ins.tipo), a, b);
+        }
+
+        auto encontrado = vistos.find(clave);
+        if (encontrado != vistos.end()) {
+            ins.op = CodigoOp::Copia;
+            ins.a = encontrado->second;
+            ins.b = 0;
+            numero[ins.destino] = encontrado->second;
+            cambios++;
+        }
+        else {
+            vistos.emplace(clave, ins.destino);
+            numero[ins.destino] = ins.destino;
+        }
+    }
+    return cambios;
+}
+
+// Sustituye cada uso de un temporal copiado por el temporal original
+size_t propagarCopias(Programa& prog) {
+    size_t cambios = 0;
+    vector<uint32_t> original(prog.temporales);
+    for (uint32_t i = 0; i < prog.temporales; i++) original[i] = i;
+
+    for (Instruccion& ins : prog.instrucciones) {
+        if (usaTemporales(ins.op)) {
+            cambios += original[ins.a] != ins.a;
+            ins.a = original[ins.a];
+            if (esBinaria(ins.op)) {
+                cambios += original[ins.b] != ins.b;
+                ins.b = original[ins.b];
+            }
+        }
+        if (ins.op == CodigoOp::Copia) {
+            original[ins.destino] = ins.a;
+        }
+    }
+    prog.resultado = original[prog.resultado];
+    return cambios;
+}
+
+/* Quita las instrucciones cuyo temporal no llega al resultado y renumera los temporales y
+literales que quedan para que t[] siga siendo denso */
+size_t eliminarTemporalesMuertos(Programa& prog) {
+    vector<char> vivo(prog.temporales, 0);
+    vivo[prog.resultado] = 1;
+    for (size_t i = prog.instrucciones.size(); i-- > 0;) {
+        const Instruccion& ins = prog.instrucciones[i];
+        if (!vivo[ins.destino] || !usaTemporales(ins.op)) continue;
+        vivo[ins.a] = 1;
+        if (esBinaria(ins.op)) vivo[ins.b] = 1;
+    }
+
+    vector<uint32_t> nuevoTemporal(prog.temporales);
+    vector<string_view> literales;
+    vector<float> valores;
+    size_t escritas = 0;
+    uint32_t temporales = 0;
+    for (Instruccion ins : prog.instrucciones) {
+        if (!vivo[ins.destino]) continue;
+        if (ins.op == CodigoOp::Cargar) {
+            literales.push_back(prog.literales[ins.a]);
+            valores.push_back(prog.valores[ins.a]);
+            ins.a = uint32_t(literales.size() - 1);
+        }
+        else if (ins.op != CodigoOp::Variable) {
+            ins.a = nuevoTemporal[ins.a];
+            if (esBinaria(ins.op)) ins.b = nuevoTemporal[ins.b];
+        }
+        nuevoTemporal[ins.destino] = temporales;
+        ins.destino = temporales++;
+        prog.instrucciones[escritas++] = ins;
+    }
+    size_t eliminadas = prog.instrucciones.size() - escritas;
+    prog.instrucciones.resize(escritas);
+    prog.literales = move(literales);
+    prog.valores = move(valores);
+    prog.resultado = nuevoTemporal[prog.resultado];
+    prog.temporales = temporales;
+    return eliminadas;
+}
+
+/* Asignacion de registros: reordena el programa y reutiliza los temporales que ya murieron,
+asi t[] deja de crecer con el numero de nodos. Es el ultimo pase porque el resultado ya no
+asigna cada temporal una sola vez (y no se usa en los programas que --paralelo va a partir,
+que lo necesitan, ver seParticiona).
+- Las instrucciones se emiten en un recorrido en postorden desde el resultado donde de los dos
+  operandos primero va el que necesita mas temporales (etiquetas de Sethi–Ullman): una hoja
+  necesita 1, una operacion binaria el maximo de sus operandos o uno mas si empatan. Cada
+  Cargar o Variable queda justo antes de su primer uso en lugar de todos al principio.
+- Luego en una pasada cada operando libera su temporal en su ultimo uso y el destino toma uno
+  libre. En un arbol el total queda en su numero de Sethi–Ullman; con subexpresiones comunes
+  el resultado de una compartida sigue vivo hasta su ultimo uso.
+Supone que ya no hay copias (propagarCopias). Regresa cuantos temporales se ahorraron */
+size_t reutilizarTemporales(Programa& prog) {
+    size_t total = prog.instrucciones.size();
+    if (total == 0) return 0;
+    vector<uint32_t> definicion(prog.temporales); // Instruccion que asigna cada temporal
+    vector<uint32_t> necesarios(total);           // Etiqueta de Sethi–Ullman de cada instruccion
+    for (uint32_t i = 0; i < total; i++) {
+        const Instruccion& ins = prog.instrucciones[i];
+        definicion[ins.destino] = i;
+        if (!usaTemporales(ins.op)) necesarios[i] = 1;
+        else if (!esBinaria(ins.op)) necesarios[i] = necesarios[definicion[ins.a]];
+        else {
+            uint32_t a = necesarios[definicion[ins.a]], b = necesarios[definicion[ins.b]];
+            necesarios[i] = a == b ? a + 1 : max(a, b);
+        }
+    }
+
+    // Postorden iterativo: (instruccion, ya se apilaron sus operandos)
+    vector<uint32_t> orden;
+    vector<char> programada(total, 0);
+    vector<pair<uint32_t, bool>> pila = { { definicion[prog.resultado], false } };
+    orden.reserve(total);
+    while (!pila.empty()) {
+        auto [i, expandida] = pila.back();
+        pila.pop_back();
+        if (expandida) {
+            orden.push_back(i);
+            continue;
+        }
+        if (programada[i]) continue;
+        programada[i] = 1;
+        pila.push_back({ i, true });
+        const Instruccion& ins = prog.instrucciones[i];
+        if (!usaTemporales(ins.op)) continue;
+        uint32_t primero = definicion[ins.a];
+        if (esBinaria(ins.op)) {
+            uint32_t segundo = definicion[ins.b];
+            if (necesarios[segundo] > necesarios[primero]) swap(primero, segundo);
+            pila.push_back({ segundo, false });
+        }
+        pila.push_back({ primero, false });
+    }
+
+    // Ultima posicion del nuevo orden que lee cada temporal; el resultado vive hasta el final
+    vector<uint32_t> ultimoUso(prog.temporales, 0);
+    for (uint32_t k = 0; k < orden.size(); k++) {
+        const Instruccion& ins = prog.instrucciones[orden[k]];
+        if (!usaTemporales(ins.op)) continue;
+        ultimoUso[ins.a] = k;
+        if (esBinaria(ins.op)) ultimoUso[ins.b] = k;
+    }
+    ultimoUso[prog.resultado] = UINT32_MAX;
+
+    vector<uint32_t> registro(prog.temporales);
+    vector<uint32_t> libres; // Pila: el temporal que se acaba de liberar es el que se reutiliza
+    vector<Instruccion> instrucciones;
+    instrucciones.reserve(orden.size());
+    uint32_t temporales = 0;
+    for (uint32_t k = 0; k < orden.size(); k++) {
+        Instruccion ins = prog.instrucciones[orden[k]];
+        if (usaTemporales(ins.op)) {
+            uint32_t a = ins.a;
+            ins.a = registro[a];
+            if (ultimoUso[a] == k) libres.push_back(ins.a);
+            if (esBinaria(ins.op)) {
+                uint32_t b = ins.b;
+                ins.b = registro[b];
+                if (ultimoUso[b] == k && b != a) libres.push_back(ins.b);
+            }
+        }
+        uint32_t destino = ins.destino;
+        if (libres.empty()) ins.destino = temporales++;
+        else {
+            ins.destino = libres.back();
+            libres.pop_back();
+        }
+        registro[destino] = ins.destino;
+        instrucciones.push_back(ins);
+    }
+    size_t ahorrados = prog.temporales - temporales;
+    prog.instrucciones = move(instrucciones);
+    prog.resultado = registro[prog.resultado];
+    prog.temporales = temporales;
+    return ahorrados;
+}
+
+// Aplica los pases en orden reportando cuantas instrucciones (o temporales) quedan despues de cada uno
+void optimizarPrograma(Contexto& ctx) {
+    struct Pase {
+        const char* nombre;
+        size_t (*aplicar)(Programa&); // Regresa cuantas instrucciones (o temporales) modifico o quito
+        bool temporales;              // Reporta temporales en lugar de instrucciones
+    };
+    static const Pase pases[] = {
+        { "Plegado de constantes", plegarConstantes, false },
+        { "Subexpresiones comunes", eliminarSubexpresionesComunes, false },
+        { "Propagacion de copias", propagarCopias, false },
+        { "Temporales muertos", eliminarTemporalesMuertos, false },
+        { "Reutilizacion de temporales", reutilizarTemporales, true },
+    };
+
+    ostream& salida = *ctx.salida;
+    bool imprimir = opciones.salida & SALIDA_IR;
+    if (imprimir) salida << "Optimizacion\n";
+    for (const Pase& pase : pases) {
+        if (pase.aplicar == reutilizarTemporales && (!opciones.reutilizar || seParticiona(ctx.programa))) continue;
+        const Programa& prog = ctx.programa;
+        size_t antes = pase.temporales ? prog.temporales : prog.instrucciones.size();
+        size_t cambios = pase.aplicar(ctx.programa);
+        if (imprimir) {
+            salida << pase.nombre << ": " << antes << " -> " << (pase.temporales ? prog.temporales : prog.instrucciones.size())
+                   << (pase.temporales ? " temporales (" : " instrucciones (") << cambios << " cambios)\n";
+        }
+    }
+    if (imprimir) salida << "\n";
+}
+
+// Manejador de errores, registra el codigo en el contexto para que el llamador decida si continuar
+void errores(Contexto& ctx, int error) {
+    ostream& salida = *ctx.salida;
+    switch (error) {
+    case 1:
+        salida << "Error 1.- Caracter '" << ctx.entrada[ctx.posicionError] << "' NO valido\n";
+        break;
+    case 2:
+        salida << "Error 2.- Posible ambiguedad en la cadena ingresada\n";
+        break;
+    case 3:
+        salida << "Error 3.- Tipo de dato incorrecto\n";
+        break;
+    case 4:
+        salida << "Error 4.- Se intento dividir entre 0\n";
+        break;
+    case 5:
+        salida << "Error 5.- Cadena incompleta o mal formada\n";
+        break;
+    case 6:
+        salida << "Error 6.- La variable '" << ctx.detalleError << "' no tiene valor\n";
+        break;
+    default:
+        salida << "Error no identificado\n";
+        break;
+    }
+    if (ctx.error == 0) {
+        ctx.error = error;
+    }
+}
+
+// Crear ventana y visulizar el arbol de parseo
+void verArbol(int argc, char** argv) {
+    // Inicializar OpenGL
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
+    glutInitWindowSize(800, 600);
+    glutCreateWindow("Arbol de Parseo");
+
+    initOpenGL();
+    disposicion.calcular(contexto.arbol.raiz); // Las posiciones se calculan una sola vez
+
+    glutDisplayFunc(display); // Función de visualización
+    glutKeyboardFunc(teclado); // Función de manejo de teclado
+
+    glutMainLoop(); // Ejecutar el bucle principal de OpenGL
+
+}
+
+// Etiqueta de un nodo con los caracteres especiales escapados para SVG (xml) o para DOT
+string etiquetaNodo(const Nodo* nodo, bool xml) {
+    string etiqueta;
+    for (char c : nodo->valor) {
+        if (!xml) {
+            if (c == '"' || c == '\\') etiqueta += '\\';
+            etiqueta += c;
+            continue;
+        }
+        switch (c) {
+        case '<': etiqueta += "&lt;"; break;
+        case '>': etiqueta += "&gt;"; break;
+        case '&': etiqueta += "&amp;"; break;
+        case '"': etiqueta += "&quot;"; break;
+        default: etiqueta += c;
+        }
+    }
+    return etiqueta;
+}
+
+/* Escribe el arbol como SVG con las posiciones de la disposicion, sin abrir ventanas. Las
+lineas van en un solo path para que el archivo siga siendo manejable con 10^5 nodos */
+void exportarSvg(ostream& salida, const DisposicionArbol& disposicion) {
+    const float ANCHO = 40, ALTO = 60, MARGEN = 30, RADIO = 14;
+    size_t n = disposicion.nodos.size();
+    auto px = [&](size_t v) { return MARGEN + disposicion.x[v] * ANCHO; };
+    auto py = [&](size_t v) { return MARGEN + disposicion.nivel[v] * ALTO; };
+    salida << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << 2 * MARGEN + disposicion.ancho() * ANCHO
+           << "\" height=\"" << 2 * MARGEN + disposicion.profundidad() * ALTO << "\" font-family=\"sans-serif\" font-size=\"12\">\n";
+    salida << "<rect width=\"100%\" height=\"100%\" fill=\"black\"/>\n<path stroke=\"white\" d=\"";
+    for (size_t v = 1; v < n; v++) {
+        size_t p = size_t(disposicion.padre[v]);
+        salida << "M" << px(p) << " " << py(p) << "L" << px(v) << " " << py(v);
+    }
+    salida << "\"/>\n";
+    for (size_t v = 0; v < n; v++) {
+        if (esNoTerminal(disposicion.nodos[v]->simbolo)) {
+            salida << "<circle cx=\"" << px(v) << "\" cy=\"" << py(v) << "\" r=\"" << RADIO << "\" fill=\"blue\"/>\n";
+        }
+        salida << "<text x=\"" << px(v) << "\" y=\"" << py(v) + 4 << "\" fill=\"white\" text-anchor=\"middle\">"
+               << etiquetaNodo(disposicion.nodos[v], true) << "</text>\n";
+    }
+    salida << "</svg>\n";
+}
+
+/* Escribe el arbol en el formato DOT de Graphviz. Cada nodo lleva su posicion fija (pos="x,y!"),
+asi "neato -n" lo dibuja con la misma disposicion en lugar de calcular otra */
+void exportarDot(ostream& salida, const DisposicionArbol& disposicion) {
+    const float ANCHO = 54, ALTO = 72; // En puntos
+    size_t n = disposicion.nodos.size();
+    salida << "digraph arbol {\n  node [fontname=\"sans-serif\"];\n";
+    for (size_t v = 0; v < n; v++) {
+        const Nodo* nodo = disposicion.nodos[v];
+        salida << "  n" << v << " [label=\"" << etiquetaNodo(nodo, false) << "\", shape=" << (esNoTerminal(nodo->simbolo) ? "circle" : "plaintext")
+               << ", pos=\"" << disposicion.x[v] * ANCHO << "," << -disposicion.nivel[v] * ALTO << "!\"];\n";
+    }
+    for (size_t v = 1; v < n; v++) {
+        salida << "  n" << disposicion.padre[v] << " -> n" << v << ";\n";
+    }
+    salida << "}\n";
+}
+
+/* Mide el tiempo de una fase mientras exista el objeto y lo suma a las estadisticas del
+contexto. Sin --stats no toma el tiempo */
+class MedidorFase {
+public:
+    MedidorFase(Contexto& ctx, Fase fase) : destino(nullptr) {
+        if (opciones.estadisticas) {
+            destino = &ctx.estadisticas.segundos[size_t(fase)];
+            inicio = chrono::steady_clock::now();
+        }
+    }
+
+    ~MedidorFase() {
+        if (destino) *destino += chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    }
+
+private:
+    double* destino;
+    chrono::steady_clock::time_point inicio;
+};
+
+/* Histograma con cubetas logaritmicas (16 por cada potencia de 2, error menor al 7%) para
+calcular percentiles de un lote sin guardar cada medicion */
+class Histograma {
+public:
+    static constexpr int SUBDIVISIONES = 16;
+
+    void agregar(uint64_t valor) {
+        cubetas[indice(valor)]++;
+        total++;
+    }
+
+    void combinar(const Histograma& otro) {
+        for (size_t i = 0; i < cubetas.size(); i++) cubetas[i] += otro.cubetas[i];
+        total += otro.total;
+    }
+
+    // Valor central de la cubeta donde cae el percentil 'p' (de 0 a 1)
+    uint64_t percentil(double p) const {
+        if (total == 0) return 0;
+        uint64_t buscado = uint64_t(ceil(p * total));
+        uint64_t acumulado = 0;
+        for (size_t i = 0; i < cubetas.size(); i++) {
+            acumulado += cubetas[i];
+            if (acumulado >= max<uint64_t>(buscado, 1)) return centro(i);
+        }
+        return centro(cubetas.size() - 1);
+    }
+
+    uint64_t cantidad() const { return total; }
+
+private:
+    static size_t indice(uint64_t valor) {
+        if (valor < SUBDIVISIONES) return size_t(valor);
+        int exponente = 63 - __builtin_clzll(valor); // Al menos 4
+        return size_t(exponente - 3) * SUBDIVISIONES + size_t((valor >> (exponente - 4)) & (SUBDIVISIONES - 1));
+    }
+
+    static uint64_t centro(size_t i) {
+        if (i < SUBDIVISIONES) return i;
+        int exponente = int(i / SUBDIVISIONES) + 3;
+        uint64_t inicio = uint64_t(SUBDIVISIONES + i % SUBDIVISIONES) << (exponente - 4);
+        return inicio + (uint64_t(1) << (exponente - 4)) / 2;
+    }
+
+    array<uint64_t, 61 * SUBDIVISIONES> cubetas{};
+    uint64_t total = 0;
+};
+
+// Percentiles de las estadisticas de todas las expresiones de un lote
+struct ResumenEstadisticas {
+    Histograma nanosegundos[NUM_FASES];
+    Histograma tokens, nodos, temporales, asignaciones, picoBytes;
+
+    void agregar(const Contexto& ctx) {
+        const Estadisticas& e = ctx.estadisticas;
+        for (size_t f = 0; f < NUM_FASES; f++) nanosegundos[f].agregar(uint64_t(e.segundos[f] * 1e9));
+        tokens.agregar(ctx.cadena.size());
+        nodos.agregar(ctx.arbol.nodos);
+        temporales.agregar(ctx.programa.temporales);
+        asignaciones.agregar(e.asignaciones);
+        picoBytes.agregar(e.picoBytes);
+    }
+
+    void combinar(const ResumenEstadisticas& otro) {
+        for (size_t f = 0; f < NUM_FASES; f++) nanosegundos[f].combinar(otro.nanosegundos[f]);
+        tokens.combinar(otro.tokens);
+        nodos.combinar(otro.nodos);
+        temporales.combinar(otro.temporales);
+        asignaciones.combinar(otro.asignaciones);
+        picoBytes.combinar(otro.picoBytes);
+    }
+
+    // Una linea JSON con p50, p90, p99 y p99.9 de cada medicion
+    void imprimir(ostream& salida) const {
+        auto percentiles = [&](const char* nombre, const Histograma& h) {
+            salida << "\"" << nombre << "\":{\"p50\":" << h.percentil(0.5) << ",\"p90\":" << h.percentil(0.9)
+                   << ",\"p99\":" << h.percentil(0.99) << ",\"p999\":" << h.percentil(0.999) << "}";
+        };
+        salida << "{\"expresiones\":" << tokens.cantidad() << ",\"nanosegundos\":{";
+        for (size_t f = 0; f < NUM_FASES; f++) {
+            if (f) salida << ",";
+            percentiles(nombresFase[f], nanosegundos[f]);
+        }
+        salida << "},";
+        percentiles("tokens", tokens);
+        salida << ",";
+        percentiles("nodos", nodos);
+        salida << ",";
+        percentiles("temporales", temporales);
+        salida << ",";
+        percentiles("asignaciones", asignaciones);
+        salida << ",";
+        percentiles("pico_bytes", picoBytes);
+        salida << "}\n";
+    }
+};
+
+// Linea JSON con las estadisticas de la expresion recien compilada
+void imprimirEstadisticas(ostream& salida, const Contexto& ctx) {
+    const Estadisticas& e = ctx.estadisticas;
+    salida << "{\"error\":" << ctx.error << ",\"tokens\":" << ctx.cadena.size() << ",\"nodos\":" << ctx.arbol.nodos
+           << ",\"temporales\":" << ctx.programa.temporales << ",\"asignaciones\":" << e.asignaciones
+           << ",\"pico_bytes\":" << e.picoBytes << ",\"segundos\":{";
+    for (size_t f = 0; f < NUM_FASES; f++) {
+        salida << (f ? "," : "") << "\"" << nombresFase[f] << "\":" << e.segundos[f];
+    }
+    salida << "}}\n";
+}
+
+/* Evalua la expresion con la maquina virtual. Con --repetir se vuelve a ejecutar el mismo
+codigo de bytes para medir cuantas evaluaciones por segundo se alcanzan */
+void evaluarConMaquina(Contexto& ctx) {
+    SalidaBuffer& salida = *ctx.salida;
+    if (!ctx.programa.variables.empty()) {
+        // Sin datos de entrada no hay valores para las variables, ver --columnas
+        ctx.detalleError = string(ctx.programa.variables[0]);
+        errores(ctx, 6);
+        return;
+    }
+    compilarBytecode(ctx.programa, ctx.bytecode);
+    ctx.maquina.preparar(ctx.bytecode);
+
+    float resultado = 0;
+    bool traza = opciones.salida & SALIDA_TRAZA;
+    if (traza) salida << "Maquina virtual (" << ctx.bytecode.codigo.size() << " palabras, " << ctx.bytecode.registros << " registros)\n";
+    int error = opciones.traza && traza ? ctx.maquina.ejecutarConTraza(ctx.bytecode, resultado, salida)
+                                        : ctx.maquina.ejecutar(ctx.bytecode, resultado);
+    if (error) {
+        errores(ctx, error);
+        return;
+    }
+    if (opciones.salida & SALIDA_RESULTADO) {
+        salida.texto("Resultado = ").texto(ctx.bytecode.flotante ? "to_float( " : "to_int( ").flotante(resultado).texto(" )\n");
+    }
+    ctx.resultado = resultado;
+
+    if (opciones.repeticiones > 0) {
+        auto inicio = chrono::steady_clock::now();
+        for (size_t i = 0; i < opciones.repeticiones; i++) {
+            ctx.maquina.ejecutar(ctx.bytecode, resultado);
+        }
+        double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        salida << "Evaluaciones: " << opciones.repeticiones << " en " << segundos << " s, "
+               << (segundos > 0 ? opciones.repeticiones / segundos : 0) << " evaluaciones/s\n";
+    }
+}
+
+/* Cola de trabajo de un hilo: bloques de lineas del lote o tareas de la evaluacion paralela.
+Los demas hilos roban del principio cuando se quedan sin trabajo, asi una expresion larga no
+deja nucleos ociosos. En la evaluacion el dueño toma del final (lo ultimo que libero, con sus
+operandos en cache); en el lote tambien del principio, para terminar primero lo que se imprime antes */
+struct ColaTrabajo {
+    mutex candado;
+    deque<size_t> bloques;
+
+    void poner(size_t bloque) {
+        lock_guard<mutex> guardia(candado);
+        bloques.push_back(bloque);
+    }
+
+    bool tomar(size_t& bloque) {
+        lock_guard<mutex> guardia(candado);
+        if (bloques.empty()) return false;
+        bloque = bloques.back();
+        bloques.pop_back();
+        return true;
+    }
+
+    bool robar(size_t& bloque) {
+        lock_guard<mutex> guardia(candado);
+        if (bloques.empty()) return false;
+        bloque = bloques.front();
+        bloques.pop_front();
+        return true;
+    }
+};
+
+// Aplica una instruccion que no es Cargar ni Variable. Regresa falso si divide entre 0
+inline bool aplicarInstruccion(const Instruccion& ins, float* t) {
+    switch (ins.op) {
+    case CodigoOp::Negacion:
+        t[ins.destino] = -t[ins.a];
+        return true;
+    case CodigoOp::Copia:
+        t[ins.destino] = t[ins.a];
+        return true;
+    default:
+        if (ins.op == CodigoOp::Division && t[ins.b] == 0) return false;
+        t[ins.destino] = aplicarOperacion(ins.op, t[ins.a], t[ins.b]);
+        return true;
+    }
+}
+
+// Evalua el programa en orden en un solo hilo, sin imprimir pasos. Regresa 0 o 4
+int evaluarSecuencial(const Programa& prog, vector<float>& t, const float* variables = nullptr) {
+    t.resize(prog.temporales);
+    for (const Instruccion& ins : prog.instrucciones) {
+        if (ins.op == CodigoOp::Cargar) t[ins.destino] = prog.valores[ins.a];
+        else if (ins.op == CodigoOp::Variable) t[ins.destino] = variables[ins.a];
+        else if (!aplicarInstruccion(ins, t.data())) return 4;
+    }
+    return 0;
+}
+
+/* Evaluacion paralela de una sola expresion grande. El lenguaje intermedio es un DAG (un arbol
+si no se optimizo); se parte en tareas de al menos 'umbral' instrucciones que se ejecutan con
+colas de trabajo y robo, y cada tarea empieza cuando terminaron las tareas de las que lee.
+Cada instruccion se calcula una vez con los mismos operandos que en orden, por eso el
+resultado es identico bit por bit al secuencial.
+
+La particion se arma en una pasada en orden (los operandos van antes que quien los usa):
+- los Cargar y Variable se evaluan antes de repartir y no pertenecen a ninguna tarea;
+- cada instruccion abre un grupo con los grupos abiertos de sus operandos, y el grupo se cierra
+  como tarea al llegar al umbral, si su temporal se usa mas de una vez o si nadie lo usa;
+- en una cadena como a*b + c*d + e*f + ... cada + depende de la tarea anterior, pero los
+  terminos no: los operandos que no dependen de ninguna tarea pasan a un lote aparte que se
+  cierra antes que quien lo usa, asi los terminos se evaluan mientras avanza la cadena.
+Las tareas se numeran al cerrarse y solo dependen de tareas con numero menor, no hay ciclos */
+class EvaluadorParalelo {
+public:
+    void particionar(const Programa& prog, size_t umbral) {
+        const vector<Instruccion>& instrucciones = prog.instrucciones;
+        size_t n = instrucciones.size();
+        productor.assign(prog.temporales, NINGUNA);
+        estado.assign(n, 0);
+        operandos.assign(n, { NINGUNA, NINGUNA });
+        for (size_t i = 0; i < n; i++) {
+            const Instruccion& ins = instrucciones[i];
+            productor[ins.destino] = uint32_t(i);
+            if (!usaTemporales(ins.op)) continue;
+            estado[i] = OPERACION;
+            for (size_t k = 0; k < (esBinaria(ins.op) ? 2 : 1); k++) {
+                uint32_t j = productor[k == 0 ? ins.a : ins.b];
+                // Solo importa si cada temporal se usa 0, 1 o mas veces
+                if (estado[j] & USADO) estado[j] |= COMPARTIDO;
+                estado[j] |= USADO;
+                if (estado[j] & OPERACION) operandos[i][k] = j;
+            }
+        }
+
+        tarea.assign(n, NINGUNA);
+        peso.assign(n, 0);
+        raicesLote.clear();
+        aristas.clear();
+        size_t pesoLote = 0;
+        uint32_t tareas = 0;
+
+        // Asigna la tarea a la raiz y a los miembros de su grupo abierto y anota las tareas de las que lee
+        auto asignar = [&](uint32_t raiz, uint32_t id) {
+            pendientesDfs.push_back(raiz);
+            while (!pendientesDfs.empty()) {
+                uint32_t i = pendientesDfs.back();
+                pendientesDfs.pop_back();
+                tarea[i] = id;
+                for (uint32_t j : operandos[i]) {
+                    if (j == NINGUNA) continue;
+                    if (tarea[j] == NINGUNA) pendientesDfs.push_back(j);
+                    else if (tarea[j] != id) aristas.push_back({ tarea[j], id });
+                }
+            }
+        };
+        auto cerrarLote = [&] {
+            if (raicesLote.empty()) return;
+            for (uint32_t raiz : raicesLote) {
+                estado[raiz] &= ~EN_LOTE;
+                asignar(raiz, tareas);
+            }
+            tareas++;
+            raicesLote.clear();
+            pesoLote = 0;
+        };
+        auto libre = [&](uint32_t j) {
+            return j != NINGUNA && tarea[j] == NINGUNA && !(estado[j] & (EN_LOTE | EXTERNO));
+        };
+        auto esperaTarea = [&](uint32_t j) {
+            return j != NINGUNA && (tarea[j] != NINGUNA || (estado[j] & (EN_LOTE | EXTERNO)));
+        };
+
+        for (size_t i = 0; i < n; i++) {
+            if (!(estado[i] & OPERACION)) continue;
+            const array<uint32_t, 2>& ops = operandos[i];
+
+            // Un operando sin dependencias junto a uno que espera otra tarea se manda al lote
+            if ((libre(ops[0]) && esperaTarea(ops[1])) || (libre(ops[1]) && esperaTarea(ops[0]))) {
+                uint32_t j = libre(ops[0]) ? ops[0] : ops[1];
+                estado[j] |= EN_LOTE;
+                raicesLote.push_back(j);
+                pesoLote += peso[j];
+            }
+
+            uint32_t total = 1;
+            uint8_t banderas = 0;
+            for (uint32_t j : ops) {
+                if (j == NINGUNA) continue;
+                if (tarea[j] != NINGUNA) banderas |= EXTERNO;
+                else if (estado[j] & EN_LOTE) banderas |= EXTERNO | USA_LOTE;
+                else {
+                    total += peso[j];
+                    banderas |= estado[j] & (EXTERNO | USA_LOTE);
+                }
+            }
+            peso[i] = total;
+            estado[i] |= banderas;
+
+            // Se cierra al llegar al umbral, si se comparte o si nadie lo usa (el resultado)
+            if ((estado[i] & COMPARTIDO) || !(estado[i] & USADO) || total >= umbral) {
+                if (banderas & USA_LOTE) cerrarLote();
+                asignar(uint32_t(i), tareas++);
+            }
+            if (pesoLote >= umbral) cerrarLote();
+        }
+        cerrarLote();
+
+        // Miembros de cada tarea en orden de instruccion (ordenamiento por conteo)
+        inicioTarea.assign(tareas + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            if (tarea[i] != NINGUNA) inicioTarea[tarea[i] + 1]++;
+        }
+        for (size_t k = 0; k < tareas; k++) inicioTarea[k + 1] += inicioTarea[k];
+        miembros.resize(inicioTarea[tareas]);
+        siguiente.assign(inicioTarea.begin(), inicioTarea.end() - 1);
+        for (size_t i = 0; i < n; i++) {
+            if (tarea[i] != NINGUNA) miembros[siguiente[tarea[i]]++] = uint32_t(i);
+        }
+
+        // Dependencias entre tareas, en listas compactas por tarea de origen y sin repetir
+        sort(aristas.begin(), aristas.end());
+        aristas.erase(unique(aristas.begin(), aristas.end()), aristas.end());
+        dependencias.assign(tareas, 0);
+        inicioDependientes.assign(tareas + 1, 0);
+        dependientes.resize(aristas.size());
+        for (size_t e = 0; e < aristas.size(); e++) {
+            inicioDependientes[aristas[e].first + 1]++;
+            dependencias[aristas[e].second]++;
+            dependientes[e] = aristas[e].second;
+        }
+        for (size_t k = 0; k < tareas; k++) inicioDependientes[k + 1] += inicioDependientes[k];
+    }
+
+    size_t tareas() const { return dependencias.size(); }
+
+    /* Decide si conviene partir el programa para evaluarlo 'evaluaciones' veces con 'hilos' hilos.
+    La particion cuesta unas COSTO_PARTICION evaluaciones secuenciales, asi que solo se paga si se
+    reparte en varias evaluaciones (--repetir) y hay nucleos de sobra: con h nucleos cada evaluacion
+    ahorra (1 - 1/h) de una secuencial */
+    static bool conviene(size_t instrucciones, size_t umbral, size_t hilos, size_t evaluaciones) {
+        size_t nucleos = min<size_t>(hilos, max(1u, thread::hardware_concurrency()));
+        if (instrucciones < 2 * umbral || nucleos < 2) return false;
+        return double(evaluaciones) * double(nucleos - 1) > COSTO_PARTICION * double(nucleos);
+    }
+
+    ~EvaluadorParalelo() {
+        {
+            lock_guard<mutex> guardia(candado);
+            cerrar = true;
+        }
+        avisoRonda.notify_all();
+        for (thread& trabajador : trabajadores) trabajador.join();
+    }
+
+    /* Evalua con 'hilos' hilos (el que llama es uno de ellos). Regresa 0 o 4 si algun divisor
+    fue 0; en ese caso los hilos dejan de tomar tareas. Los hilos se crean la primera vez que se
+    piden y esperan dormidos la siguiente evaluacion; con un hilo se evalua en orden de instruccion,
+    sin colas, que da los mismos temporales */
+    int evaluar(const Programa& prog, size_t hilos, vector<float>& t, const float* variables = nullptr) {
+        if (hilos <= 1) return evaluarSecuencial(prog, t, variables);
+        t.resize(prog.temporales);
+        for (const Instruccion& ins : prog.instrucciones) {
+            if (ins.op == CodigoOp::Cargar) t[ins.destino] = prog.valores[ins.a];
+            else if (ins.op == CodigoOp::Variable) t[ins.destino] = variables[ins.a];
+        }
+
+        size_t total = tareas();
+        if (capacidadPendientes < total) {
+            pendientes.reset(new atomic<uint32_t>[total]);
+            capacidadPendientes = total;
+        }
+        if (!colas || hilosColas < hilos) {
+            colas.reset(new ColaTrabajo[hilos]);
+            hilosColas = hilos;
+        }
+        for (size_t h = 0; h < hilos; h++) colas[h].bloques.clear(); // Una division entre 0 deja tareas sin tomar
+        int64_t listasIniciales = 0;
+        for (size_t k = 0; k < total; k++) {
+            pendientes[k].store(dependencias[k], memory_order_relaxed);
+            if (dependencias[k] == 0) {
+                colas[k % hilos].poner(k);
+                listasIniciales++;
+            }
+        }
+        while (trabajadores.size() + 1 < hilos) {
+            size_t h = trabajadores.size() + 1;
+            trabajadores.emplace_back([this, h] { esperarRondas(h); });
+        }
+
+        // Abrir la ronda: los hilos 1..hilos-1 la toman, los demas siguen dormidos
+        {
+            lock_guard<mutex> guardia(candado);
+            programa = &prog;
+            temporales = t.data();
+            hilosRonda = hilos;
+            totalRonda = total;
+            listas.store(listasIniciales, memory_order_relaxed);
+            terminadas.store(0, memory_order_relaxed);
+            divisionEntreCero.store(false, memory_order_relaxed);
+            activos = hilos - 1;
+            ronda++;
+        }
+        avisoRonda.notify_all();
+        trabajar(0);
+
+        // Nadie puede seguir leyendo el estado de la ronda cuando regresa
+        unique_lock<mutex> guardia(candado);
+        avisoFin.wait(guardia, [&] { return activos == 0; });
+        return divisionEntreCero.load(memory_order_relaxed) ? 4 : 0;
+    }
+
+private:
+    static constexpr uint32_t NINGUNA = UINT32_MAX;
+    static constexpr double COSTO_PARTICION = 6; // En evaluaciones secuenciales, ver particion_en_evaluaciones de --benchmark-paralelo
+
+    // Cuerpo de cada hilo del grupo: duerme hasta que se abre una ronda que lo incluye
+    void esperarRondas(size_t h) {
+        uint64_t vista = 0;
+        for (;;) {
+            {
+                unique_lock<mutex> guardia(candado);
+                avisoRonda.wait(guardia, [&] { return cerrar || (ronda != vista && h < hilosRonda); });
+                if (cerrar) return;
+                vista = ronda;
+            }
+            trabajar(h);
+            lock_guard<mutex> guardia(candado);
+            if (--activos == 0) avisoFin.notify_one();
+        }
+    }
+
+    bool rondaTerminada() const {
+        return terminadas.load(memory_order_acquire) >= totalRonda || divisionEntreCero.load(memory_order_relaxed);
+    }
+
+    // Toma tareas de su cola y roba de las demas; si no hay ninguna lista duerme hasta que otra se libere
+    void trabajar(size_t h) {
+        const vector<Instruccion>& instrucciones = programa->instrucciones;
+        float* t = temporales;
+        size_t hilos = hilosRonda;
+        size_t k;
+        while (!rondaTerminada()) {
+            bool hay = colas[h].tomar(k);
+            for (size_t v = 1; !hay && v < hilos; v++) hay = colas[(h + v) % hilos].robar(k);
+            if (!hay) {
+                unique_lock<mutex> guardia(candado);
+                avisoTareas.wait(guardia, [&] { return listas.load(memory_order_relaxed) > 0 || rondaTerminada(); });
+                continue;
+            }
+            listas.fetch_sub(1, memory_order_relaxed);
+            for (uint32_t m = inicioTarea[k]; m < inicioTarea[k + 1]; m++) {
+                if (!aplicarInstruccion(instrucciones[miembros[m]], t)) {
+                    {
+                        lock_guard<mutex> guardia(candado);
+                        divisionEntreCero = true;
+                    }
+                    avisoTareas.notify_all();
+                    return;
+                }
+            }
+            // Las tareas que quedan listas las toma este mismo hilo, sus operandos estan en su cache
+            size_t nuevas = 0;
+            for (uint32_t d = inicioDependientes[k]; d < inicioDependientes[k + 1]; d++) {
+                if (pendientes[dependientes[d]].fetch_sub(1, memory_order_acq_rel) == 1) {
+                    colas[h].poner(dependientes[d]);
+                    nuevas++;
+                }
+            }
+            bool ultima = terminadas.fetch_add(1, memory_order_acq_rel) + 1 == totalRonda;
+            if (nuevas > 1 || ultima) {
+                // Con el candado tomado ningun hilo queda entre revisar 'listas' y dormirse
+                {
+                    lock_guard<mutex> guardia(candado);
+                    listas.fetch_add(int64_t(nuevas), memory_order_relaxed);
+                }
+                avisoTareas.notify_all();
+            }
+            else if (nuevas == 1) listas.fetch_add(1, memory_order_relaxed); // Este hilo la toma en la siguiente vuelta
+        }
+    }
+
+    // Banderas de cada instruccion durante la particion
+    enum : uint8_t {
+        OPERACION = 1,  // No es Cargar ni Variable
+        USADO = 2,      // Alguna instruccion lee su temporal
+        COMPARTIDO = 4, // Mas de una instruccion lo lee
+        EN_LOTE = 8,    // Raiz de un grupo que se paso al lote de operandos libres
+        EXTERNO = 16,   // Su grupo abierto lee de alguna tarea (o del lote)
+        USA_LOTE = 32   // Su grupo abierto lee del lote
+    };
+
+    // Arreglos de trabajo de la particion, se conservan para no volver a pedir memoria
+    vector<uint32_t> productor;              // Instruccion que escribe cada temporal
+    vector<uint8_t> estado;                  // Banderas de cada instruccion
+    vector<array<uint32_t, 2>> operandos;    // Instrucciones de operacion que lee cada una (NINGUNA si es Cargar o Variable)
+    vector<uint32_t> peso;                   // Instrucciones del grupo abierto de cada raiz
+    vector<uint32_t> raicesLote, pendientesDfs, siguiente;
+    vector<pair<uint32_t, uint32_t>> aristas; // (tarea de la que se lee, tarea que espera)
+
+    vector<uint32_t> tarea;              // Tarea de cada instruccion (NINGUNA para Cargar y Variable)
+    vector<uint32_t> inicioTarea;        // Miembros de la tarea k: miembros[inicioTarea[k] .. inicioTarea[k+1])
+    vector<uint32_t> miembros;
+    vector<uint32_t> dependencias;       // Cuantas aristas llegan a cada tarea
+    vector<uint32_t> inicioDependientes; // Igual que inicioTarea, para las tareas que esperan a cada una
+    vector<uint32_t> dependientes;
+
+    // Estado de la evaluacion en curso (una ronda), compartido con el grupo de hilos
+    unique_ptr<atomic<uint32_t>[]> pendientes; // Dependencias que le faltan a cada tarea
+    size_t capacidadPendientes = 0;
+    unique_ptr<ColaTrabajo[]> colas;
+    size_t hilosColas = 0;
+    const Programa* programa = nullptr;
+    float* temporales = nullptr;
+    size_t hilosRonda = 0, totalRonda = 0;
+    atomic<int64_t> listas{ 0 }; // Tareas en las colas sin tomar (puede bajar de 0 un momento)
+    atomic<size_t> terminadas{ 0 };
+    atomic<bool> divisionEntreCero{ false };
+
+    // Grupo de hilos, vive lo que vive el evaluador
+    vector<thread> trabajadores;
+    mutex candado;
+    condition_variable avisoRonda, avisoTareas, avisoFin;
+    uint64_t ronda = 0;
+    size_t activos = 0; // Hilos del grupo que no han salido de la ronda
+    bool cerrar = false;
+};
+
+/* Si la evaluacion con --paralelo va a partir este programa. Tambien lo consulta
+optimizarPrograma: un programa que se parte necesita un temporal por instruccion, los que se
+evaluan en orden pueden reutilizarlos */
+bool seParticiona(const Programa& prog) {
+    return opciones.hilosEvaluacion > 0 && !opciones.maquinaVirtual
+        && EvaluadorParalelo::conviene(prog.instrucciones.size(), opciones.umbral, opciones.hilosEvaluacion,
+                                       opciones.repeticiones + 1);
+}
+
+/* Evalua con EvaluadorParalelo (--paralelo N) si la particion se paga: la expresion debe dar al
+menos dos tareas y evaluarse suficientes veces (con --repetir) en varios nucleos, ver
+EvaluadorParalelo::conviene. Si no, se evalua en orden. El evaluador de cada hilo se reutiliza
+con sus arreglos y su grupo de hilos */
+void evaluarEnParalelo(Contexto& ctx) {
+    thread_local EvaluadorParalelo evaluador;
+    const Programa& prog = ctx.programa;
+    SalidaBuffer& salida = *ctx.salida;
+    if (!prog.variables.empty()) {
+        // Sin datos de entrada no hay valores para las variables, ver --columnas
+        ctx.detalleError = string(prog.variables[0]);
+        errores(ctx, 6);
+        return;
+    }
+
+    vector<float> t;
+    bool paralela = seParticiona(prog);
+    auto evaluar = [&] {
+        return paralela ? evaluador.evaluar(prog, opciones.hilosEvaluacion, t) : evaluarSecuencial(prog, t);
+    };
+    if (paralela) {
+        auto inicio = chrono::steady_clock::now();
+        evaluador.particionar(prog, opciones.umbral);
+        double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        if (opciones.salida & SALIDA_TRAZA) salida << "Evaluacion paralela (" << evaluador.tareas() << " tareas, " << opciones.hilosEvaluacion
+               << " hilos, particion en " << segundos * 1e3 << " ms)\n";
+    }
+    else if (opciones.salida & SALIDA_TRAZA) {
+        salida << "Evaluacion secuencial (" << prog.instrucciones.size() << " instrucciones, umbral " << opciones.umbral
+               << ", " << opciones.repeticiones + 1 << " evaluaciones, " << thread::hardware_concurrency() << " nucleos)\n";
+    }
+    int error = evaluar();
+    if (error) {
+        errores(ctx, error);
+        return;
+    }
+    if (opciones.salida & SALIDA_RESULTADO) {
+        salida.texto("Resultado = ").texto(textoConversion(prog.instrucciones.back())).flotante(t[prog.resultado]).texto(" )\n");
+    }
+    ctx.resultado = t[prog.resultado];
+
+    // La particion se hace una vez, las repeticiones solo evaluan
+    if (opciones.repeticiones > 0) {
+        auto inicio = chrono::steady_clock::now();
+        for (size_t i = 0; i < opciones.repeticiones; i++) evaluar();
+        double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        salida << "Evaluaciones: " << opciones.repeticiones << " en " << segundos << " s, "
+               << (segundos > 0 ? opciones.repeticiones / segundos : 0) << " evaluaciones/s\n";
+    }
+}
+
+/* Cache LRU de programas compilados. La clave es la cadena tokenizada normalizada (los
+espacios no cuentan) y el valor es el lenguaje intermedio terminado, ya optimizado si se pidio
+--optimizar (la clave incluye las opciones de optimizacion), junto con su tabla de valores y de
+que literal de la cadena viene cada uno. En un acierto solo se vuelven a enlazar los textos de
+literales y variables con la entrada actual.
+En modo parametrico la clave solo guarda el tipo de cada literal y no su valor, asi 3+4*2 y
+5+1*9 comparten el mismo programa; ahi se guarda el programa sin optimizar y sin valores,
+porque el plegado depende de los literales de cada expresion. Sin parametros, las expresiones
+sin variables guardan ademas su resultado ya evaluado */
+class CacheProgramas {
+public:
+    struct Entrada {
+        string clave;
+        vector<Instruccion> instrucciones;
+        vector<float> valores; // Vacios en modo parametrico, ver enlazarHojas
+        vector<uint32_t> hojas;
+        uint32_t temporales = 0;
+        uint32_t resultado = 0;
+        bool evaluada = false; // Si 'valor' tiene el resultado de la expresion
+        float valor = 0;
+
+        size_t bytes() const {
+            return sizeof(Entrada) + clave.capacity() + instrucciones.capacity() * sizeof(Instruccion)
+                 + valores.capacity() * sizeof(float) + hojas.capacity() * sizeof(uint32_t) + 64; // 64: nodos de la lista y el mapa
+        }
+    };
+
+    size_t aciertos = 0, fallos = 0, desalojos = 0;
+
+    void configurar(size_t limiteBytes, bool parametrica) {
+        limite = limiteBytes;
+        parametros = parametrica;
+    }
+
+    bool activa() const { return limite > 0; }
+    bool parametrica() const { return parametros; }
+
+    // Clave normalizada de la cadena tokenizada del contexto
+    void construirClave(const Contexto& ctx, string& clave) const {
+        clave.clear();
+        if (!parametros) clave += char('0' + opciones.optimizar + 2 * opciones.reutilizar);
+        for (const Token& token : ctx.cadena) {
+            clave += char('A' + int(token.tipo));
+            if (token.tipo == TipoToken::Num) {
+                clave += token.flotante ? 'f' : 'i';
+                if (parametros) continue;
+            }
+            else if (token.tipo != TipoToken::Id) continue;
+            clave += ctx.texto(token);
+            clave += ';';
+        }
+    }
+
+    /* Si la clave del contexto existe copia su programa sobre la memoria del programa del
+    contexto, enlazado con la entrada actual, y la marca como la mas reciente. Si el resultado
+    ya estaba evaluado tambien lo deja en el contexto */
+    bool buscar(Contexto& ctx) {
+        lock_guard<mutex> guardia(candado);
+        auto it = indice.find(ctx.claveCache);
+        if (it == indice.end()) {
+            fallos++;
+            return false;
+        }
+        aciertos++;
+        entradas.splice(entradas.begin(), entradas, it->second);
+        const Entrada& encontrada = *it->second;
+        Programa& prog = ctx.programa;
+        prog.instrucciones.assign(encontrada.instrucciones.begin(), encontrada.instrucciones.end());
+        prog.valores.assign(encontrada.valores.begin(), encontrada.valores.end());
+        prog.temporales = encontrada.temporales;
+        prog.resultado = encontrada.resultado;
+        enlazarHojas(ctx, encontrada.hojas);
+        if (encontrada.evaluada) {
+            ctx.resultadoEnCache = true;
+            ctx.resultado = encontrada.valor;
+        }
+        return true;
+    }
+
+    // Guarda el programa del contexto con su clave
+    void guardar(const Contexto& ctx) {
+        const string& clave = ctx.claveCache;
+        const Programa& prog = ctx.programa;
+        Entrada nueva;
+        nueva.clave = clave;
+        nueva.instrucciones = prog.instrucciones;
+        if (!parametros) {
+            // Cada texto de la tabla es la vista de un literal de la cadena, se busca por su posicion
+            vector<const char*> textos;
+            for (const Token& token : ctx.cadena) {
+                if (token.tipo == TipoToken::Num) textos.push_back(ctx.texto(token).data());
+            }
+            nueva.valores = prog.valores;
+            nueva.hojas.reserve(prog.literales.size());
+            for (string_view literal : prog.literales) {
+                auto it = lower_bound(textos.begin(), textos.end(), literal.data(), less<const char*>());
+                bool enCadena = !literal.empty() && it != textos.end() && *it == literal.data();
+                nueva.hojas.push_back(enCadena ? uint32_t(it - textos.begin()) : SIN_TEXTO);
+            }
+        }
+        nueva.temporales = prog.temporales;
+        nueva.resultado = prog.resultado;
+        lock_guard<mutex> guardia(candado);
+        if (indice.count(clave) || nueva.bytes() > limite) return;
+        bytesUsados += nueva.bytes();
+        entradas.push_front(move(nueva));
+        indice.emplace(entradas.front().clave, entradas.begin());
+        while (bytesUsados > limite) {
+            const Entrada& ultima = entradas.back();
+            bytesUsados -= ultima.bytes();
+            indice.erase(ultima.clave);
+            entradas.pop_back();
+            desalojos++;
+        }
+    }
+
+    // Guarda el resultado ya evaluado de una expresion sin variables ni parametros
+    void guardarResultado(const string& clave, float valor) {
+        lock_guard<mutex> guardia(candado);
+        auto it = indice.find(clave);
+        if (it == indice.end()) return;
+        it->second->evaluada = true;
+        it->second->valor = valor;
+    }
+
+    void reportar(ostream& salida) const {
+        if (!activa()) return;
+        size_t consultas = aciertos + fallos;
+        salida << "Cache: " << aciertos << " aciertos, " << fallos << " fallos ("
+               << (consultas ? 100.0 * aciertos / consultas : 0) << "% aciertos), " << desalojos << " desalojos, "
+               << entradas.size() << " programas en " << bytesUsados << " bytes\n";
+    }
+
+private:
+    size_t limite = 0;       // Presupuesto de memoria en bytes, 0 desactiva la cache
+    bool parametros = false;
+    size_t bytesUsados = 0;
+    list<Entrada> entradas;  // De la mas reciente a la mas antigua
+    unordered_map<string_view, list<Entrada>::iterator> indice; // Las claves apuntan a las de la lista
+    mutex candado;
+};
+CacheProgramas cacheProgramas;
+
+// Fases de analisis y generacion del lenguaje intermedio, se detiene en el primer error
+bool traducir(Contexto& ctx) {
+    SalidaBuffer& salida = *ctx.salida;
+    {
+        MedidorFase medidor(ctx, Fase::Lexer);
+        lexer(ctx, ctx.entrada); // Tokenizar cadena
+    }
+    if (ctx.error) return false;
+
+    // Si no hay errores en la cadena imprime la tokenizacion
+    if (opciones.salida & SALIDA_TOKENS) {
+        salida.texto("Cadena Tokenizada: ");
+        for (const Token& token : ctx.cadena) {
+            salida.texto(nombreToken(token.tipo)).caracter(' ');
+        }
+        salida.texto("\n\n");
+    }
+
+    /* Con la cache activa, una cadena ya compilada se salta el analisis y la generacion. Solo
+    los programas parametricos se vuelven a optimizar, con los literales de esta expresion */
+    if (cacheProgramas.activa()) {
+        cacheProgramas.construirClave(ctx, ctx.claveCache);
+        if (cacheProgramas.buscar(ctx)) {
+            if (opciones.optimizar) {
+                if (cacheProgramas.parametrica()) optimizarPrograma(ctx);
+                else if (opciones.salida & SALIDA_IR) salida.texto("Optimizacion (en cache)\n\n");
+            }
+            if (opciones.salida & SALIDA_IR) imprimirPrograma(salida, ctx.programa);
+            return true;
+        }
+    }
+
+    if (opciones.arbol) {
+        {
+            MedidorFase medidor(ctx, Fase::Parser);
+            parser(ctx); // Analizar y construir el árbol
+        }
+        if (ctx.error) return false;
+        MedidorFase medidor(ctx, Fase::Generacion);
+        generarLenguaje(ctx);
+    }
+    else {
+        // Sin arbol el analisis y la generacion son una sola pasada, se mide como parser
+        MedidorFase medidor(ctx, Fase::Parser);
+        traducirSinArbol(ctx);
+    }
+    if (ctx.error) return false;
+    bool guardarAntes = cacheProgramas.activa() && cacheProgramas.parametrica();
+    if (guardarAntes) cacheProgramas.guardar(ctx);
+    if (opciones.optimizar) {
+        MedidorFase medidor(ctx, Fase::Optimizacion);
+        optimizarPrograma(ctx);
+    }
+    if (cacheProgramas.activa() && !guardarAntes) cacheProgramas.guardar(ctx);
+    if (opciones.salida & SALIDA_IR) imprimirPrograma(salida, ctx.programa);
+    return true;
+}
+
+// Evalua el programa del contexto con el evaluador que eligen las opciones
+void evaluarPrograma(Contexto& ctx) {
+    if (opciones.maquinaVirtual) evaluarConMaquina(ctx);
+    else if (opciones.hilosEvaluacion > 0) evaluarEnParalelo(ctx);
+    else resolverOperacion(ctx);
+}
+
+// Ejecuta todas las fases sobre una expresion, se detiene en el primer error
+bool compilar(Contexto& ctx) {
+    ContadorMemoria memoriaInicial = memoriaHilo;
+    memoriaHilo.pico = memoriaHilo.vivos;
+    {
+        MedidorFase medidor(ctx, Fase::Total);
+        if (traducir(ctx)) {
+            MedidorFase medidorEvaluacion(ctx, Fase::Evaluacion);
+            if (ctx.resultadoEnCache) {
+                if (opciones.salida & SALIDA_RESULTADO) {
+                    ctx.salida->texto("Resultado = ").texto(textoConversion(ctx.programa.instrucciones.back()))
+                        .flotante(ctx.resultado).texto(" ) (en cache)\n");
+                }
+            }
+            else {
+                evaluarPrograma(ctx);
+            }
+            // Sin variables ni parametros el resultado no cambia, se guarda para la siguiente vez
+            if (!ctx.error && !ctx.resultadoEnCache && cacheProgramas.activa() && !cacheProgramas.parametrica()
+                && ctx.programa.variables.empty()) {
+                cacheProgramas.guardarResultado(ctx.claveCache, ctx.resultado);
+            }
+        }
+    }
+    if (opciones.estadisticas) {
+        ctx.estadisticas.asignaciones = memoriaHilo.asignaciones - memoriaInicial.asignaciones;
+        ctx.estadisticas.picoBytes = uint64_t(memoriaHilo.pico - memoriaInicial.vivos);
+        memoriaHilo.pico = max(memoriaHilo.pico, memoriaInicial.pico);
+        imprimirEstadisticas(*ctx.salida, ctx);
+    }
+    return ctx.error == 0;
+}
+
+/* Lector de lineas para archivos grandes. Si la entrada es un archivo regular se mapea en
+memoria y cada linea es una vista directa sobre el mapa; si no (tuberias, entrada estandar o
+sistemas sin mmap) se lee en trozos de tamaño fijo moviendo al inicio la linea que quedo
+partida entre dos trozos. En ningun caso se copian las lineas y la memoria residente no
+depende del tamaño del archivo */
+class LectorLineas {
+public:
+    static constexpr size_t TAM_TROZO = 1 << 20;      // Bytes por lectura en el modo por trozos
+    static constexpr size_t TAM_LIBERAR = 64u << 20;  // Bytes consumidos del mapa antes de soltar paginas
+
+    ~LectorLineas() {
+        cerrar();
+    }
+
+    // Abre el archivo ("-" es la entrada estandar). Regresa falso si no se puede leer
+    bool abrir(const string& ruta) {
+        cerrar();
+        if (ruta == "-") {
+            flujo = &cin;
+            prepararTrozos();
+            return true;
+        }
+#if USAR_MMAP
+        int descriptor = open(ruta.c_str(), O_RDONLY);
+        if (descriptor < 0) return false;
+        struct stat informacion;
+        if (fstat(descriptor, &informacion) == 0 && S_ISREG(informacion.st_mode)) {
+            tamMapa = size_t(informacion.st_size);
+            if (tamMapa > 0) {
+                void* direccion = mmap(nullptr, tamMapa, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (direccion != MAP_FAILED) {
+                    mapa = static_cast<const char*>(direccion);
+                    madvise(direccion, tamMapa, MADV_SEQUENTIAL);
                 }
-                for (int j = 0; j < igual; j++) {
-                    cout << operaciones[0][j];
+            }
+            if (mapa || tamMapa == 0) {
+                ::close(descriptor);
+                return true;
+            }
+        }
+        ::close(descriptor);
+#endif
+        archivo.open(ruta, ios::binary);
+        if (!archivo) return false;
+        flujo = &archivo;
+        prepararTrozos();
+        return true;
+    }
+
+    /* Entrega la siguiente linea sin el salto ni el '\r' final. Con el archivo mapeado las
+    vistas son validas hasta cerrar el lector; leyendo por trozos solo hasta la siguiente llamada */
+    bool siguiente(string_view& linea) {
+        if (mapa || !flujo) {
+            if (posicion >= tamMapa) return false;
+            const char* inicio = mapa + posicion;
+            const char* salto = static_cast<const char*>(memchr(inicio, '\n', tamMapa - posicion));
+            size_t longitud = salto ? size_t(salto - inicio) : tamMapa - posicion;
+            posicion += longitud + (salto ? 1 : 0);
+            leidos = posicion;
+            linea = recortar(string_view(inicio, longitud));
+            return true;
+        }
+        for (;;) {
+            const char* inicio = buffer.data() + inicioTrozo;
+            const char* salto = static_cast<const char*>(memchr(inicio, '\n', finTrozo - inicioTrozo));
+            if (salto) {
+                size_t longitud = salto - inicio;
+                inicioTrozo += longitud + 1;
+                leidos += longitud + 1;
+                linea = recortar(string_view(inicio, longitud));
+                return true;
+            }
+            if (agotado) {
+                if (inicioTrozo == finTrozo) return false;
+                linea = recortar(string_view(inicio, finTrozo - inicioTrozo));
+                leidos += finTrozo - inicioTrozo;
+                inicioTrozo = finTrozo;
+                return true;
+            }
+            // Mover la linea partida al inicio y leer el siguiente trozo; si una linea no cabe se crece el buffer
+            memmove(buffer.data(), inicio, finTrozo - inicioTrozo);
+            finTrozo -= inicioTrozo;
+            inicioTrozo = 0;
+            if (finTrozo == buffer.size()) buffer.resize(buffer.size() * 2);
+            flujo->read(buffer.data() + finTrozo, buffer.size() - finTrozo);
+            size_t leidosTrozo = size_t(flujo->gcount());
+            finTrozo += leidosTrozo;
+            if (leidosTrozo == 0) agotado = true;
+        }
+    }
+
+    /* Avisa que ya no se usan las lineas entregadas antes del byte 'consumido' (por omision todas
+    las entregadas), para soltar las paginas ya recorridas del mapa y que la memoria residente no
+    crezca con el archivo */
+    void liberarConsumido(uint64_t consumido = UINT64_MAX) {
+#if USAR_MMAP
+        size_t fin = size_t(min<uint64_t>(consumido, posicion));
+        if (!mapa || fin < liberado || fin - liberado < TAM_LIBERAR) return;
+        size_t pagina = size_t(sysconf(_SC_PAGESIZE));
+        size_t hasta = fin / pagina * pagina;
+        madvise(const_cast<char*>(mapa) + liberado, hasta - liberado, MADV_DONTNEED);
+        liberado = hasta;
+#endif
+    }
+
+    // Verdadero si las lineas siguen siendo validas despues de pedir la siguiente
+    bool vistasEstables() const { return mapa != nullptr; }
+    uint64_t bytesLeidos() const { return leidos; }
+
+    void cerrar() {
+#if USAR_MMAP
+        if (mapa) munmap(const_cast<char*>(mapa), tamMapa);
+#endif
+        mapa = nullptr;
+        tamMapa = posicion = liberado = 0;
+        if (archivo.is_open()) archivo.close();
+        flujo = nullptr;
+        inicioTrozo = finTrozo = 0;
+        agotado = false;
+        leidos = 0;
+    }
+
+private:
+    // Con el buffer vacio data() puede ser nulo, y memchr y memmove no lo aceptan aun con 0 bytes
+    void prepararTrozos() {
+        if (buffer.size() < TAM_TROZO) buffer.resize(TAM_TROZO);
+    }
+
+    static string_view recortar(string_view linea) {
+        if (!linea.empty() && linea.back() == '\r') linea.remove_suffix(1);
+        return linea;
+    }
+
+    // Archivo mapeado
+    const char* mapa = nullptr;
+    size_t tamMapa = 0;
+    size_t posicion = 0;
+    size_t liberado = 0;
+
+    // Lectura por trozos
+    istream* flujo = nullptr;
+    ifstream archivo;
+    vector<char> buffer;
+    size_t inicioTrozo = 0, finTrozo = 0;
+    bool agotado = false;
+
+    uint64_t leidos = 0;
+};
+
+// Bytes leidos del archivo del lote y su velocidad
+void reportarLectura(const LectorLineas& lector, double segundos) {
+    double megas = lector.bytesLeidos() / 1e6;
+    cerr << "Lectura: " << megas << " MB " << (lector.vistasEstables() ? "mapeados" : "por trozos") << ", "
+         << (segundos > 0 ? megas / segundos : 0) << " MB/s\n";
+}
+
+// Compila una linea del lote y escribe su bloque de resultados en 'salida'
+bool procesarLinea(Contexto& ctx, size_t numeroLinea, string_view linea, SalidaBuffer& salida) {
+    ctx.reiniciar();
+    ctx.entrada = linea;
+    ctx.salida = &salida;
+    salida.texto("== Linea ").entero(numeroLinea).texto(": ").texto(linea).caracter('\n');
+    bool correcta = compilar(ctx);
+    if (ctx.arbol.raiz) {
+        salida << "Arbol: " << ctx.arbol.nodos << " nodos, " << ctx.arbol.bytesUsados() << " bytes ("
+               << ctx.arbol.bytesReservados() << " bytes reservados)\n";
+    }
+    salida.caracter('\n');
+    return correcta;
+}
+
+// Estadisticas de un hilo del lote paralelo
+struct EstadisticaHilo {
+    size_t procesadas = 0;
+    size_t fallidas = 0;
+    size_t robos = 0;
+    double segundos = 0; // Tiempo ocupado compilando
+    ResumenEstadisticas resumen; // Solo con --stats
+};
+
+/* Lote paralelo: el hilo principal lee las lineas por ventanas y reparte cada ventana en bloques
+entre los hilos, cada uno con su propio contexto. Los hilos se crean una vez y toman bloques de
+cualquier ventana en vuelo, asi una expresion larga no detiene a los demas hasta que termine su
+ventana; mientras tanto el hilo principal lee las siguientes (hasta VENTANAS en memoria). Cada
+bloque escribe sus resultados en memoria y el hilo principal los imprime en el orden de entrada
+en cuanto estan listos */
+int procesarLoteParalelo(LectorLineas& lector, size_t hilos) {
+    const size_t LINEAS_POR_BLOQUE = 32;
+    const size_t VENTANA = 64 * 1024; // Lineas por ventana
+    const size_t VENTANAS = 3;        // Ventanas en memoria a la vez: la que se imprime y las que se compilan o leen
+    const size_t BLOQUES_POR_VENTANA = (VENTANA + LINEAS_POR_BLOQUE - 1) / LINEAS_POR_BLOQUE;
+
+    // Lineas de una ventana y resultados de sus bloques; el bloque b de la ventana v se encola como v * BLOQUES_POR_VENTANA + b
+    struct Ventana {
+        vector<string_view> lineas;
+        vector<string> copias; // Solo si las vistas del lector no sobreviven a la siguiente lectura
+        vector<size_t> numeros;
+        vector<string> resultados;
+        unique_ptr<atomic<bool>[]> listo;
+        size_t bloques = 0;
+        uint64_t finBytes = 0; // Bytes del archivo leidos al cerrar la ventana
+    };
+
+    vector<Contexto> contextos(hilos);
+    vector<EstadisticaHilo> estadisticas(hilos);
+    vector<ColaTrabajo> colas(hilos);
+    vector<Ventana> ventanas(VENTANAS);
+    for (Ventana& ventana : ventanas) {
+        ventana.resultados.resize(BLOQUES_POR_VENTANA);
+        ventana.listo.reset(new atomic<bool>[BLOQUES_POR_VENTANA]);
+        if (!lector.vistasEstables()) ventana.copias.reserve(VENTANA); // Sin realojar, las vistas a las copias no cambian
+    }
+    mutex candado;
+    condition_variable avisoTrabajo, avisoListo;
+    atomic<size_t> disponibles(0); // Bloques encolados que nadie ha tomado
+    bool terminar = false;
+    SalidaBuffer escritor(SalidaBuffer::SALIDA_ESTANDAR); // Junta los bloques ya ordenados para escribirlos de una vez
+    auto inicio = chrono::steady_clock::now();
+
+    auto trabajar = [&](size_t h) {
+        SalidaBuffer salida;
+        size_t bloque;
+        for (;;) {
+            // Tambien de la propia cola se toma el bloque mas antiguo, es el primero que se imprime
+            bool hay = colas[h].robar(bloque);
+            for (size_t v = 1; !hay && v < hilos; v++) {
+                hay = colas[(h + v) % hilos].robar(bloque);
+                if (hay) estadisticas[h].robos++;
+            }
+            if (!hay) {
+                unique_lock<mutex> guardia(candado);
+                avisoTrabajo.wait(guardia, [&] { return disponibles.load() > 0 || terminar; });
+                if (disponibles.load() == 0) return;
+                continue;
+            }
+            disponibles.fetch_sub(1);
+
+            Ventana& ventana = ventanas[bloque / BLOQUES_POR_VENTANA];
+            bloque %= BLOQUES_POR_VENTANA;
+            auto inicioBloque = chrono::steady_clock::now();
+            salida.limpiar();
+            size_t fin = min(ventana.lineas.size(), (bloque + 1) * LINEAS_POR_BLOQUE);
+            for (size_t i = bloque * LINEAS_POR_BLOQUE; i < fin; i++) {
+                if (!procesarLinea(contextos[h], ventana.numeros[i], ventana.lineas[i], salida)) estadisticas[h].fallidas++;
+                estadisticas[h].procesadas++;
+                if (opciones.estadisticas) estadisticas[h].resumen.agregar(contextos[h]);
+            }
+            ventana.resultados[bloque] = string(salida.vista());
+            estadisticas[h].segundos += chrono::duration<double>(chrono::steady_clock::now() - inicioBloque).count();
+            {
+                lock_guard<mutex> guardia(candado);
+                ventana.listo[bloque] = true;
+            }
+            avisoListo.notify_one();
+        }
+    };
+    vector<thread> trabajadores;
+    for (size_t h = 0; h < hilos; h++) trabajadores.emplace_back(trabajar, h);
+
+    string_view linea;
+    size_t numeroLinea = 0;
+    size_t primera = 0, enVuelo = 0; // Ventanas en vuelo: primera, primera + 1, ... (circular)
+    bool quedan = true;
+    for (;;) {
+        // Leer ventanas de lineas no vacias mientras haya lugar y encolar sus bloques
+        while (quedan && enVuelo < VENTANAS) {
+            size_t indice = (primera + enVuelo) % VENTANAS;
+            Ventana& ventana = ventanas[indice];
+            ventana.lineas.clear();
+            ventana.copias.clear();
+            ventana.numeros.clear();
+            while (ventana.lineas.size() < VENTANA && (quedan = lector.siguiente(linea))) {
+                numeroLinea++;
+                if (linea.find_first_not_of(' ') == string_view::npos) continue; // Lineas vacias no generan bloque
+                if (!lector.vistasEstables()) {
+                    ventana.copias.emplace_back(linea);
+                    linea = ventana.copias.back();
                 }
-                cout << "to_int( " << temp << " )\n"; /*Si el numero no tiene punto decimal
-                lo convierte a entero*/
-                t[paso] = stof(temp);
+                ventana.lineas.push_back(linea);
+                ventana.numeros.push_back(numeroLinea);
+            }
+            if (ventana.lineas.empty()) break;
+            ventana.finBytes = lector.bytesLeidos();
+            ventana.bloques = (ventana.lineas.size() + LINEAS_POR_BLOQUE - 1) / LINEAS_POR_BLOQUE;
+            for (size_t b = 0; b < ventana.bloques; b++) ventana.listo[b] = false;
+            {
+                lock_guard<mutex> guardia(candado);
+                disponibles += ventana.bloques;
+                for (size_t b = 0; b < ventana.bloques; b++) colas[b % hilos].poner(indice * BLOQUES_POR_VENTANA + b);
+            }
+            avisoTrabajo.notify_all();
+            enVuelo++;
+        }
+        if (enVuelo == 0) break;
+
+        // Imprimir los bloques de la ventana mas antigua en orden conforme se terminan
+        Ventana& ventana = ventanas[primera];
+        for (size_t b = 0; b < ventana.bloques; b++) {
+            unique_lock<mutex> guardia(candado);
+            avisoListo.wait(guardia, [&] { return ventana.listo[b].load(); });
+            guardia.unlock();
+            escritor.texto(ventana.resultados[b]);
+            escritor.vaciarSiLleno();
+            string().swap(ventana.resultados[b]);
+        }
+        lector.liberarConsumido(ventana.finBytes);
+        primera = (primera + 1) % VENTANAS;
+        enVuelo--;
+    }
+    {
+        lock_guard<mutex> guardia(candado);
+        terminar = true;
+    }
+    avisoTrabajo.notify_all();
+    for (thread& trabajador : trabajadores) trabajador.join();
+
+    escritor.vaciar();
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    size_t procesadas = 0, fallidas = 0;
+    for (size_t h = 0; h < hilos; h++) {
+        const EstadisticaHilo& e = estadisticas[h];
+        procesadas += e.procesadas;
+        fallidas += e.fallidas;
+        if (opciones.estadisticas && h > 0) estadisticas[0].resumen.combinar(e.resumen);
+        cerr << "Hilo " << h << ": " << e.procesadas << " expresiones, " << e.robos << " bloques robados, "
+             << (e.segundos > 0 ? e.procesadas / e.segundos : 0) << " expresiones/s\n";
+    }
+    cerr << "Expresiones procesadas: " << procesadas << " (" << fallidas << " con error) en "
+         << segundos << " s, " << (segundos > 0 ? procesadas / segundos : 0) << " expresiones/s con "
+         << hilos << " hilos\n";
+    reportarLectura(lector, segundos);
+    cacheProgramas.reportar(cerr);
+    if (opciones.estadisticas) estadisticas[0].resumen.imprimir(cout);
+    return 0;
+}
+
+/* Modo por lotes: compila una expresion por linea del archivo (o de la entrada estandar si es "-")
+reutilizando un mismo contexto y reporta el rendimiento al final. Con --hilos N mayor a 1
+las lineas se reparten entre N hilos */
+int procesarLote(const string& ruta) {
+    LectorLineas lector;
+    if (!lector.abrir(ruta)) {
+        cerr << "No se pudo abrir el archivo '" << ruta << "'\n";
+        return 1;
+    }
+    if (opciones.hilos > 1) {
+        return procesarLoteParalelo(lector, opciones.hilos);
+    }
+
+    Contexto ctx;
+    SalidaBuffer salida(SalidaBuffer::SALIDA_ESTANDAR);
+    ResumenEstadisticas resumen;
+    string_view linea;
+    size_t numeroLinea = 0, procesadas = 0, fallidas = 0;
+    auto inicio = chrono::steady_clock::now();
+
+    while (lector.siguiente(linea)) {
+        numeroLinea++;
+        if (linea.find_first_not_of(' ') == string_view::npos) continue; // Lineas vacias no generan bloque
+
+        if (!procesarLinea(ctx, numeroLinea, linea, salida)) fallidas++;
+        procesadas++;
+        if (opciones.estadisticas) resumen.agregar(ctx);
+        salida.vaciarSiLleno();
+        lector.liberarConsumido();
+    }
+    salida.vaciar();
+
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    cerr << "Expresiones procesadas: " << procesadas << " (" << fallidas << " con error) en "
+         << segundos << " s, " << (segundos > 0 ? procesadas / segundos : 0) << " expresiones/s\n";
+    reportarLectura(lector, segundos);
+    cacheProgramas.reportar(cerr);
+    if (opciones.estadisticas) resumen.imprimir(cout);
+    return 0;
+}
+
+/* Compara memoria por nodo y velocidad de recorrido entre el arbol de nodos con apuntadores
+y el arbol compacto, sobre una expresion generada de 'terminos' productos alternados con sumas */
+int compararArboles(size_t terminos) {
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    for (size_t i = 0; i < terminos; i++) {
+        if (i > 0) ctx.almacen += (i % 2 == 1) ? '*' : '+';
+        ctx.almacen += to_string(i % 9 + 1);
+    }
+    ctx.entrada = ctx.almacen;
+    lexer(ctx, ctx.entrada);
+    parser(ctx);
+    if (ctx.error) {
+        cerr << "No se pudo analizar la expresion generada\n";
+        return 1;
+    }
+
+    ArbolCompacto compacto;
+    compacto.desde(ctx.arbol);
+
+    const int repeticiones = 20;
+    int alturaNodos = 0, alturaCompacta = 0;
+    auto inicio = chrono::steady_clock::now();
+    for (int r = 0; r < repeticiones; r++) alturaNodos = ctx.arbol.altura(ctx.arbol.raiz);
+    double tiempoNodos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count() / repeticiones;
+    inicio = chrono::steady_clock::now();
+    for (int r = 0; r < repeticiones; r++) alturaCompacta = compacto.altura();
+    double tiempoCompacto = chrono::duration<double>(chrono::steady_clock::now() - inicio).count() / repeticiones;
+
+    cout << "Terminos: " << terminos << ", nodos: " << ctx.arbol.nodos << ", literales distintos: " << compacto.literales.size() << "\n";
+    cout << "Arbol de nodos:   " << double(ctx.arbol.bytesUsados()) / ctx.arbol.nodos << " bytes/nodo, altura "
+         << alturaNodos << " en " << tiempoNodos * 1e3 << " ms\n";
+    cout << "Arbol compacto:   " << double(compacto.bytes()) / compacto.nodos() << " bytes/nodo, altura "
+         << alturaCompacta << " en " << tiempoCompacto * 1e3 << " ms\n";
+    return 0;
+}
+
+// Parametros del generador de expresiones de prueba
+struct ParametrosGenerador {
+    size_t tokens = 1000;     // Tokens aproximados de cada expresion
+    int profundidad = 3;      // Anidamiento maximo de ( <E> )
+    int menos = 1;            // Largo maximo de las cadenas de - unario
+    double flotantes = 0.5;   // Proporcion de literales con punto decimal
+    double parentesis = 0.2;  // Probabilidad de que un factor sea ( <E> )
+    uint64_t semilla = 1;
+    size_t cantidad = 1;      // Expresiones que imprime --generar
+};
+
+/* Generador de expresiones validas de la gramatica con semilla fija. Ademas de la gramatica
+respeta las reglas de encontrarAmbiguedad: un operador nunca queda a dos tokens de otro de su
+misma clase y, a partir del primer operador seguido de '(', ningun ')' va seguido de un operador
+de esa clase. Solo se divide entre literales para no provocar el error 4 */
+class GeneradorExpresiones {
+public:
+    explicit GeneradorExpresiones(const ParametrosGenerador& parametros)
+        : p(parametros), azar(parametros.semilla) {}
+
+    string generar() {
+        texto.clear();
+        clases.clear();
+        clasePrimerParentesis = Ninguna;
+        expresion(0, max<size_t>(1, p.tokens));
+        return texto;
+    }
+
+private:
+    enum Clase : uint8_t { Ninguna = 0, Aditiva = 1, Multiplicativa = 2 };
+
+    // <E>: factores unidos por operadores hasta llegar a 'objetivo' tokens
+    void expresion(int nivel, size_t objetivo) {
+        size_t inicio = clases.size();
+        factor(nivel, objetivo, false);
+        while (clases.size() - inicio < objetivo) {
+            bool divide = operador();
+            factor(nivel, objetivo - min(objetivo, clases.size() - inicio), divide);
+        }
+    }
+
+    // <U>: ( <E> ) o un literal precedido de una cadena de - unarios
+    void factor(int nivel, size_t restantes, bool soloLiteral) {
+        if (!soloLiteral && nivel < p.profundidad && restantes > 4 && probabilidad() < p.parentesis) {
+            if (!clases.empty() && clases.back() != Ninguna && clasePrimerParentesis == Ninguna) {
+                clasePrimerParentesis = clases.back();
+            }
+            emitir('(', Ninguna);
+            expresion(nivel + 1, 1 + azar() % min<size_t>(restantes - 2, 16));
+            emitir(')', Ninguna);
+            return;
+        }
+        int menos = p.menos > 0 ? int(azar() % (p.menos + 1)) : 0;
+        for (int i = 0; i < menos && permitida(Aditiva); i++) emitir('-', Aditiva);
+        unsigned entero = 1 + azar() % 99;
+        texto += to_string(entero);
+        if (probabilidad() < p.flotantes) {
+            texto += '.';
+            texto += char('1' + azar() % 9);
+        }
+        clases.push_back(Ninguna);
+    }
+
+    // Operador binario de una clase permitida, regresa verdadero si es una division
+    bool operador() {
+        bool aditiva = permitida(Aditiva) && (!permitida(Multiplicativa) || azar() % 2 == 0);
+        if (aditiva) {
+            emitir(azar() % 2 ? '+' : '-', Aditiva);
+            return false;
+        }
+        bool divide = azar() % 4 == 0;
+        emitir(divide ? '/' : '*', Multiplicativa);
+        return divide;
+    }
+
+    // Si un operador de la clase dada puede ir en la siguiente posicion
+    bool permitida(Clase clase) const {
+        size_t n = clases.size();
+        if (n >= 2 && clases[n - 2] == clase) return false;
+        if (n >= 1 && texto.back() == ')' && clase == clasePrimerParentesis) return false;
+        return true;
+    }
+
+    void emitir(char c, Clase clase) {
+        texto += c;
+        clases.push_back(clase);
+    }
+
+    double probabilidad() {
+        return double(azar() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    ParametrosGenerador p;
+    mt19937_64 azar;
+    string texto;
+    vector<Clase> clases;          // Clase de cada token emitido
+    Clase clasePrimerParentesis = Ninguna; // Clase del primer operador seguido de '('
+};
+
+// Repite 'fase' hasta pasar 'minimo' segundos y regresa los segundos por repeticion
+template <typename Fase>
+double medirRepetido(Fase&& fase, double minimo, size_t& repeticiones) {
+    repeticiones = 0;
+    double segundos = 0;
+    auto inicio = chrono::steady_clock::now();
+    do {
+        fase();
+        repeticiones++;
+        segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    } while (segundos < minimo);
+    return segundos / repeticiones;
+}
+
+/* Mide por separado cada fase (lexer, encontrarAmbiguedad, parser, generarLenguaje, la
+sustitucion de valores y la maquina virtual) sobre expresiones generadas de 10 a 'maximo'
+tokens. Cada medicion se imprime como una linea JSON para poder compararlas entre versiones */
+int ejecutarBenchmark(ParametrosGenerador parametros, size_t maximo) {
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    const double TIEMPO_MINIMO = 0.2; // Segundos por fase, para que las expresiones cortas se repitan
+
+    for (size_t tokens = 10; tokens <= maximo; tokens *= 10) {
+        parametros.tokens = tokens;
+        GeneradorExpresiones generador(parametros);
+        ctx.reiniciar();
+        ctx.almacen = generador.generar();
+        ctx.entrada = ctx.almacen;
+        if (!traducir(ctx)) {
+            cerr << "La expresion generada no es valida (error " << ctx.error << ")\n";
+            return 1;
+        }
+        asegurarArbol(ctx);
+        descartada.limpiar();
+
+        // Repite la fase hasta pasar el tiempo minimo y escribe su linea JSON
+        auto medir = [&](const char* etapa, auto&& fase) {
+            size_t repeticiones = 0;
+            double porRepeticion = medirRepetido(fase, TIEMPO_MINIMO, repeticiones);
+            cout << "{\"etapa\":\"" << etapa << "\",\"tokens\":" << ctx.cadena.size()
+                 << ",\"nodos\":" << ctx.arbol.nodos << ",\"instrucciones\":" << ctx.programa.instrucciones.size()
+                 << ",\"semilla\":" << parametros.semilla << ",\"profundidad\":" << parametros.profundidad
+                 << ",\"menos\":" << parametros.menos << ",\"flotantes\":" << parametros.flotantes
+                 << ",\"repeticiones\":" << repeticiones << ",\"segundos\":" << porRepeticion
+                 << ",\"ns_por_token\":" << porRepeticion * 1e9 / ctx.cadena.size() << "}\n";
+        };
+
+        medir("lexer", [&] {
+            ctx.cadena.clear();
+            lexer(ctx, ctx.entrada);
+        });
+        medir("encontrarAmbiguedad", [&] { encontrarAmbiguedad(ctx); });
+        medir("parser", [&] {
+            ctx.arbol.reiniciar();
+            parser(ctx);
+        });
+        medir("generarLenguaje", [&] { generarLenguaje(ctx); });
+        medir("traducirSinArbol", [&] { traducirSinArbol(ctx); });
+        medir("resolverOperacion", [&] {
+            descartada.limpiar();
+            resolverOperacion(ctx);
+        });
+        compilarBytecode(ctx.programa, ctx.bytecode);
+        ctx.maquina.preparar(ctx.bytecode);
+        float resultado = 0;
+        medir("maquinaVirtual", [&] { ctx.maquina.ejecutar(ctx.bytecode, resultado); });
+        if (ctx.error) {
+            cerr << "Error " << ctx.error << " al medir la expresion de " << tokens << " tokens\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Mide el parser, la altura, la generacion del lenguaje intermedio y la maquina virtual sobre
+anidamientos de 10 a 'maximo' niveles: parentesis ((...(1)...)) y cadenas de - unario. Las
+cadenas de - son ambiguas para la gramatica y se analizan sin revisar la ambiguedad. Con los
+recorridos iterativos el tiempo por nivel debe mantenerse constante */
+int ejecutarBenchmarkProfundidad(size_t maximo) {
+    const double TIEMPO_MINIMO = 0.2;
+    for (const char* anidamiento : { "parentesis", "menos" }) {
+        bool parentesis = anidamiento[0] == 'p';
+        for (size_t profundidad = 10; profundidad <= maximo; profundidad *= 10) {
+            Contexto ctx;
+            SalidaBuffer descartada;
+            ctx.salida = &descartada;
+            ctx.almacen.assign(profundidad, parentesis ? '(' : '-');
+            ctx.almacen += '1';
+            if (parentesis) ctx.almacen.append(profundidad, ')');
+            ctx.entrada = ctx.almacen;
+            lexer(ctx, ctx.entrada);
+            parser(ctx, parentesis);
+            if (ctx.error) {
+                cerr << "Error " << ctx.error << " con " << profundidad << " niveles de " << anidamiento << "\n";
+                return 1;
+            }
+            generarLenguaje(ctx);
+            compilarBytecode(ctx.programa, ctx.bytecode);
+            ctx.maquina.preparar(ctx.bytecode);
+            int altura = 0;
+            float resultado = 0;
+
+            auto medir = [&](const char* etapa, auto&& fase) {
+                size_t repeticiones = 0;
+                double porRepeticion = medirRepetido(fase, TIEMPO_MINIMO, repeticiones);
+                cout << "{\"etapa\":\"" << etapa << "\",\"anidamiento\":\"" << anidamiento << "\",\"profundidad\":" << profundidad
+                     << ",\"nodos\":" << ctx.arbol.nodos << ",\"altura\":" << altura << ",\"repeticiones\":" << repeticiones
+                     << ",\"segundos\":" << porRepeticion << ",\"ns_por_nivel\":" << porRepeticion * 1e9 / profundidad << "}\n";
+            };
+            medir("parser", [&] {
+                ctx.arbol.reiniciar();
+                parser(ctx, parentesis);
+            });
+            medir("altura", [&] { altura = ctx.arbol.altura(ctx.arbol.raiz); });
+            medir("generarLenguaje", [&] { generarLenguaje(ctx); });
+            medir("maquinaVirtual", [&] { ctx.maquina.ejecutar(ctx.bytecode, resultado); });
+        }
+    }
+    return 0;
+}
+
+/* Mide el rendimiento en GB/s del lexer byte por byte contra lexerMascaras con cada
+clasificador que soporte el procesador, sobre una sola expresion generada de al menos 'megas'
+MB. Revisa que todos produzcan los mismos tokens y escribe una linea JSON por version */
+int ejecutarBenchmarkLexer(ParametrosGenerador parametros, size_t megas) {
+    const double TIEMPO_MINIMO = 0.5;
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    parametros.tokens = megas * 1000000 / 3; // Cerca de 3 bytes por token con los parametros por omision
+    GeneradorExpresiones generador(parametros);
+    ctx.almacen = generador.generar();
+    ctx.entrada = ctx.almacen;
+    lexerEscalar(ctx, ctx.entrada);
+    vector<Token> esperados = ctx.cadena;
+
+    vector<const ClasificadorCaracteres*> clasificadores = clasificadoresDisponibles();
+
+    bool todosIguales = true;
+    auto medir = [&](const string& version, auto&& fase) {
+        size_t repeticiones = 0;
+        double segundos = medirRepetido([&] {
+            ctx.cadena.clear();
+            fase();
+        }, TIEMPO_MINIMO, repeticiones);
+        bool iguales = mismosTokens(ctx.cadena, esperados);
+        todosIguales &= iguales;
+        cout << "{\"lexer\":\"" << version << "\",\"bytes\":" << ctx.entrada.size() << ",\"tokens\":" << esperados.size()
+             << ",\"repeticiones\":" << repeticiones << ",\"segundos\":" << segundos
+             << ",\"gb_por_segundo\":" << ctx.entrada.size() / segundos / 1e9 << ",\"iguales\":" << (iguales ? "true" : "false") << "}\n";
+    };
+    medir("escalar", [&] { lexerEscalar(ctx, ctx.entrada); });
+    for (const ClasificadorCaracteres* clasificador : clasificadores) {
+        medir(string("mascaras-") + clasificador->nombre, [&] { lexerMascaras(ctx, ctx.entrada, *clasificador); });
+    }
+    return todosIguales ? 0 : 1;
+}
+
+/* Compara la evaluacion secuencial contra EvaluadorParalelo con 1, 2, 4, ... hilos sobre una
+expresion generada de 'tokens' tokens (con --optimizar el programa es un DAG). Revisa que todos
+los temporales queden identicos bit por bit y escribe una linea JSON por numero de hilos */
+int ejecutarBenchmarkParalelo(const ParametrosGenerador& parametros) {
+    const double TIEMPO_MINIMO = 0.5;
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    GeneradorExpresiones generador(parametros);
+    ctx.almacen = generador.generar();
+    ctx.entrada = ctx.almacen;
+    if (!traducir(ctx)) {
+        cerr << "Error " << ctx.error << " al traducir la expresion generada\n";
+        return 1;
+    }
+    const Programa& prog = ctx.programa;
+
+    vector<float> esperado, t;
+    size_t repeticiones = 0;
+    int errorSecuencial = 0;
+    double segundosSecuencial = medirRepetido([&] { errorSecuencial = evaluarSecuencial(prog, esperado); },
+                                              TIEMPO_MINIMO, repeticiones);
+
+    // La primera particion pide la memoria de sus arreglos, las siguientes la reutilizan
+    EvaluadorParalelo evaluador;
+    double segundosParticion = medirRepetido([&] { evaluador.particionar(prog, opciones.umbral); },
+                                             TIEMPO_MINIMO, repeticiones);
+
+    size_t maximo = max<size_t>(4, thread::hardware_concurrency());
+    bool todosIdenticos = true;
+    for (size_t hilos = 1; hilos <= maximo; hilos *= 2) {
+        int error = 0;
+        double segundos = medirRepetido([&] { error = evaluador.evaluar(prog, hilos, t); }, TIEMPO_MINIMO, repeticiones);
+        bool identico = error == errorSecuencial
+            && (error != 0 || memcmp(t.data(), esperado.data(), esperado.size() * sizeof(float)) == 0);
+        todosIdenticos &= identico;
+        cout << "{\"tokens\":" << ctx.cadena.size() << ",\"instrucciones\":" << prog.instrucciones.size()
+             << ",\"umbral\":" << opciones.umbral << ",\"tareas\":" << evaluador.tareas()
+             << ",\"particion_ms\":" << segundosParticion * 1e3 << ",\"particion_en_evaluaciones\":" << segundosParticion / segundosSecuencial
+             << ",\"hilos\":" << hilos
+             << ",\"nucleos\":" << thread::hardware_concurrency() << ",\"secuencial_ms\":" << segundosSecuencial * 1e3
+             << ",\"paralelo_ms\":" << segundos * 1e3 << ",\"aceleracion\":" << segundosSecuencial / segundos
+             << ",\"identico\":" << (identico ? "true" : "false") << "}\n";
+    }
+    return todosIdenticos ? 0 : 1;
+}
+
+/* Lee los parametros del generador de la forma --semilla S --profundidad D --menos M
+--flotantes F --parentesis P --cantidad N a partir de 'desde'. Regresa falso si alguno no se
+reconoce o su valor no es un numero */
+bool leerParametrosGenerador(const vector<string>& argumentos, size_t desde, ParametrosGenerador& parametros) {
+    for (size_t i = desde; i < argumentos.size(); i++) {
+        const string& nombre = argumentos[i];
+        if (i + 1 >= argumentos.size()) return false;
+        const string& valor = argumentos[++i];
+        bool valido;
+        if (nombre == "--semilla") valido = leerNumero(valor, parametros.semilla);
+        else if (nombre == "--profundidad") valido = leerNumero(valor, parametros.profundidad);
+        else if (nombre == "--menos") valido = leerNumero(valor, parametros.menos);
+        else if (nombre == "--flotantes") valido = leerNumero(valor, parametros.flotantes);
+        else if (nombre == "--parentesis") valido = leerNumero(valor, parametros.parentesis);
+        else if (nombre == "--cantidad") valido = leerNumero(valor, parametros.cantidad);
+        else return false;
+        if (!valido) return false;
+    }
+    return true;
+}
+
+#if USAR_SOCKETS
+/* Flujo con buffer sobre un descriptor de archivo (socket o tuberia) para usar getline y <<
+sobre conexiones igual que sobre cin y cout */
+class FlujoDescriptor : public streambuf {
+public:
+    explicit FlujoDescriptor(int descriptor) : descriptor(descriptor) {
+        setg(lectura, lectura, lectura);
+        setp(escritura, escritura + sizeof(escritura));
+    }
+
+    ~FlujoDescriptor() override {
+        sync();
+    }
+
+protected:
+    int_type underflow() override {
+        ssize_t leidos;
+        do {
+            leidos = ::read(descriptor, lectura, sizeof(lectura));
+        } while (leidos < 0 && errno == EINTR);
+        if (leidos <= 0) return traits_type::eof();
+        setg(lectura, lectura, lectura + leidos);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    int_type overflow(int_type c) override {
+        if (sync() != 0) return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        const char* p = pbase();
+        while (p < pptr()) {
+            ssize_t escritos = ::write(descriptor, p, pptr() - p);
+            if (escritos < 0 && errno == EINTR) continue;
+            if (escritos <= 0) return -1;
+            p += escritos;
+        }
+        setp(escritura, escritura + sizeof(escritura));
+        return 0;
+    }
+
+private:
+    int descriptor;
+    char lectura[64 * 1024];
+    char escritura[64 * 1024];
+};
+#endif
+
+/* Modo servidor: lee una expresion por linea y responde con una trama por expresion.
+La trama empieza con una linea "ok <resultado> <bytes>" (el resultado con todos sus digitos) o "error <codigo> <bytes>" seguida
+de exactamente <bytes> bytes con la salida del compilador (tokens, lenguaje intermedio y
+resultado o mensaje de error). Los errores solo se reportan y el servidor sigue atendiendo */
+void servir(istream& entrada, ostream& salida) {
+    Contexto ctx;
+    SalidaBuffer cuerpo;
+    string linea;
+    while (getline(entrada, linea)) {
+        if (!linea.empty() && linea.back() == '\r') linea.pop_back();
+        ctx.reiniciar();
+        ctx.entrada = linea;
+        cuerpo.limpiar();
+        ctx.salida = &cuerpo;
+        bool correcta = compilar(ctx);
+        string_view texto = cuerpo.vista();
+        if (correcta) {
+            // La forma mas corta que vuelve a dar el mismo float, no los 6 digitos de ostream
+            char numero[32];
+            char* fin = to_chars(numero, numero + sizeof(numero), ctx.resultado).ptr;
+            salida << "ok " << string_view(numero, size_t(fin - numero)) << " " << texto.size() << "\n";
+        }
+        else salida << "error " << ctx.error << " " << texto.size() << "\n";
+        salida << texto << flush;
+    }
+}
+
+#if USAR_SOCKETS
+/* Servidor en un socket Unix: cada conexion se atiende en su propio hilo con su propio
+contexto, con el mismo protocolo que la entrada estandar */
+int servirSocket(const string& ruta) {
+    int servidor = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un direccion{};
+    direccion.sun_family = AF_UNIX;
+    if (servidor < 0 || ruta.size() >= sizeof(direccion.sun_path)) {
+        cerr << "No se pudo crear el socket '" << ruta << "'\n";
+        return 1;
+    }
+    strcpy(direccion.sun_path, ruta.c_str());
+    unlink(ruta.c_str());
+    if (bind(servidor, reinterpret_cast<sockaddr*>(&direccion), sizeof(direccion)) < 0 || listen(servidor, 64) < 0) {
+        cerr << "No se pudo escuchar en '" << ruta << "': " << strerror(errno) << "\n";
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // Un cliente que se desconecta no debe terminar el servidor
+    cerr << "Escuchando en " << ruta << "\n";
+    for (;;) {
+        int conexion = accept(servidor, nullptr, nullptr);
+        if (conexion < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        thread([conexion] {
+            {
+                FlujoDescriptor flujo(conexion);
+                istream entrada(&flujo);
+                ostream salida(&flujo);
+                servir(entrada, salida);
+            }
+            ::close(conexion);
+        }).detach();
+    }
+    ::close(servidor);
+    return 0;
+}
+
+// Crea un proceso hijo que ejecuta este programa con 'argumentos', conectado por tuberias
+pid_t lanzarProceso(const string& ejecutable, const vector<string>& argumentos, int& escritura, int& lectura) {
+    int haciaHijo[2], desdeHijo[2];
+    if (pipe(haciaHijo) < 0 || pipe(desdeHijo) < 0) return -1;
+    pid_t hijo = fork();
+    if (hijo == 0) {
+        dup2(haciaHijo[0], 0);
+        dup2(desdeHijo[1], 1);
+        int nulo = open("/dev/null", O_WRONLY);
+        dup2(nulo, 2); // Los reportes del hijo no se mezclan con los del benchmark
+        ::close(haciaHijo[0]); ::close(haciaHijo[1]); ::close(desdeHijo[0]); ::close(desdeHijo[1]); ::close(nulo);
+        vector<char*> argv;
+        argv.push_back(const_cast<char*>(ejecutable.c_str()));
+        for (const string& argumento : argumentos) argv.push_back(const_cast<char*>(argumento.c_str()));
+        argv.push_back(nullptr);
+        execv(ejecutable.c_str(), argv.data());
+        _exit(127);
+    }
+    ::close(haciaHijo[0]);
+    ::close(desdeHijo[1]);
+    escritura = haciaHijo[1];
+    lectura = desdeHijo[0];
+    return hijo;
+}
+
+// Linea JSON con la latencia por solicitud (en microsegundos) de una forma de atender expresiones
+void imprimirLatencias(const char* modo, vector<double>& latencias) {
+    if (latencias.empty()) return;
+    sort(latencias.begin(), latencias.end());
+    auto percentil = [&](double p) { return latencias[min(latencias.size() - 1, size_t(p * latencias.size()))] * 1e6; };
+    double suma = 0;
+    for (double latencia : latencias) suma += latencia;
+    cout << "{\"modo\":\"" << modo << "\",\"solicitudes\":" << latencias.size() << ",\"p50_us\":" << percentil(0.5)
+         << ",\"p99_us\":" << percentil(0.99) << ",\"media_us\":" << suma / latencias.size() * 1e6 << "}\n";
+}
+
+/* Compara la latencia por expresion del modo servidor (un proceso que atiende todas) contra
+crear un proceso nuevo para cada expresion, como se hacia antes */
+int compararServidor(const string& ejecutable, size_t solicitudes, size_t tokens) {
+    ParametrosGenerador parametros;
+    parametros.tokens = tokens;
+    GeneradorExpresiones generador(parametros);
+    vector<string> expresiones(solicitudes);
+    for (string& expresion : expresiones) expresion = generador.generar() + "\n";
+    signal(SIGPIPE, SIG_IGN);
+
+    // Servidor: un solo proceso, una trama por expresion
+    vector<double> latencias;
+    int escritura, lectura;
+    bool valida = true;
+    pid_t servidor = lanzarProceso(ejecutable, { "--servidor" }, escritura, lectura);
+    if (servidor < 0) {
+        cerr << "No se pudo crear el proceso del servidor\n";
+        return 1;
+    }
+    {
+        FlujoDescriptor envio(escritura), recepcion(lectura);
+        ostream solicitud(&envio);
+        istream respuesta(&recepcion);
+        string estado, valor, cuerpo;
+        for (const string& expresion : expresiones) {
+            auto inicio = chrono::steady_clock::now();
+            solicitud << expresion << flush;
+            size_t bytes;
+            // El resultado puede ser inf o nan, que >> no lee como numero; solo importan los bytes
+            if (!(respuesta >> estado >> valor >> bytes) || respuesta.get() != '\n') {
+                valida = false;
+                break;
+            }
+            cuerpo.resize(bytes);
+            respuesta.read(&cuerpo[0], bytes);
+            latencias.push_back(chrono::duration<double>(chrono::steady_clock::now() - inicio).count());
+        }
+    }
+    // Cerrar la entrada del servidor lo termina tambien cuando su respuesta no fue valida
+    ::close(escritura);
+    ::close(lectura);
+    waitpid(servidor, nullptr, 0);
+    if (!valida) {
+        cerr << "Respuesta del servidor no valida\n";
+        return 1;
+    }
+    imprimirLatencias("servidor", latencias);
+
+    // Un proceso por expresion: crear, escribir la linea, leer hasta el final y esperar
+    latencias.clear();
+    char buffer[64 * 1024];
+    for (const string& expresion : expresiones) {
+        auto inicio = chrono::steady_clock::now();
+        pid_t hijo = lanzarProceso(ejecutable, { "--lote", "-" }, escritura, lectura);
+        if (hijo < 0) {
+            cerr << "No se pudo crear el proceso\n";
+            return 1;
+        }
+        if (::write(escritura, expresion.data(), expresion.size()) < 0) cerr << "No se pudo enviar la expresion\n";
+        ::close(escritura);
+        while (::read(lectura, buffer, sizeof(buffer)) > 0) {}
+        ::close(lectura);
+        waitpid(hijo, nullptr, 0);
+        latencias.push_back(chrono::duration<double>(chrono::steady_clock::now() - inicio).count());
+    }
+    imprimirLatencias("proceso_por_expresion", latencias);
+    return 0;
+}
+#endif
+
+/* Compila la expresion, construye su arbol de parseo y lo escribe como SVG o DOT en 'ruta'
+("-" es la salida estandar), sin necesidad de una pantalla */
+int exportarArbol(const string& formato, const string& ruta, const string& expresion) {
+    if (formato != "svg" && formato != "dot") {
+        cerr << "Formato '" << formato << "' no valido, use svg o dot\n";
+        return 1;
+    }
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    ctx.entrada = expresion;
+    if (!traducir(ctx)) {
+        cerr << descartada.vista();
+        return 1;
+    }
+    auto inicio = chrono::steady_clock::now();
+    asegurarArbol(ctx);
+    DisposicionArbol disposicion;
+    disposicion.calcular(ctx.arbol.raiz);
+    double segundosDisposicion = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    ofstream archivo;
+    ostream* salida = &cout;
+    if (ruta != "-") {
+        archivo.open(ruta);
+        if (!archivo) {
+            cerr << "No se pudo crear el archivo '" << ruta << "'\n";
+            return 1;
+        }
+        salida = &archivo;
+    }
+    inicio = chrono::steady_clock::now();
+    if (formato == "svg") exportarSvg(*salida, disposicion);
+    else exportarDot(*salida, disposicion);
+    salida->flush();
+    double segundosEscritura = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    cerr << "Arbol: " << disposicion.nodos.size() << " nodos, " << disposicion.ancho() + 1 << " columnas, "
+         << disposicion.profundidad() + 1 << " niveles; disposicion en " << segundosDisposicion * 1e3
+         << " ms, escritura en " << segundosEscritura * 1e3 << " ms\n";
+    return 0;
+}
+
+/* Traduce el lenguaje intermedio a una funcion de C 'int nombre(const float* v, float* resultado)'
+con un temporal local por instruccion; 'v' tiene el valor de cada variable en el orden de su
+tabla. El interprete evalua todo en float y to_int/to_float solo deciden como se muestra el
+valor, asi que los temporales son float (su tipo queda como comentario) y el resultado es el
+mismo, bit por bit. Como la maquina virtual, regresa 4 si se divide entre 0 */
+void emitirFuncionC(ostream& salida, const Programa& prog, const string& nombre) {
+    // Constantes en hexadecimal para que sean exactamente el float del literal
+    auto constante = [&](float valor) {
+        char texto[48];
+        if (isnan(valor)) salida << "NAN";
+        else if (isinf(valor)) salida << (valor < 0 ? "-INFINITY" : "INFINITY");
+        else {
+            snprintf(texto, sizeof(texto), "%af", double(valor));
+            salida << texto;
+        }
+    };
+
+    // Con --optimizar un temporal se puede asignar varias veces (reutilizarTemporales), se declaran todos al inicio
+    salida << "int " << nombre << "(const float* v, float* resultado) {\n    float";
+    for (uint32_t i = 0; i < prog.temporales; i++) salida << (i ? ", t" : " t") << i;
+    salida << ";\n";
+    for (const Instruccion& ins : prog.instrucciones) {
+        if (ins.op == CodigoOp::Division) salida << "    if (t" << ins.b << " == 0.0f) return 4;\n";
+        salida << "    t" << ins.destino << " = ";
+        switch (ins.op) {
+        case CodigoOp::Cargar:
+            constante(prog.valores[ins.a]);
+            break;
+        case CodigoOp::Variable:
+            salida << "v[" << ins.a << "]";
+            break;
+        case CodigoOp::Negacion:
+            salida << "-t" << ins.a;
+            break;
+        case CodigoOp::Copia:
+            salida << "t" << ins.a;
+            break;
+        default:
+            salida << "t" << ins.a << " " << simboloOperacion(ins.op) << " t" << ins.b;
+            break;
+        }
+        salida << "; /* " << (ins.tipo == TipoDato::Flotante ? "to_float" : "to_int");
+        if (ins.op == CodigoOp::Variable) salida << " " << prog.variables[ins.a];
+        salida << " */\n";
+    }
+    salida << "    *resultado = t" << prog.resultado << ";\n    return 0;\n}\n\n";
+}
+
+// Unidad de C con una funcion expresion_<i> por programa
+void emitirUnidadC(ostream& salida, const vector<Programa>& programas) {
+    salida << "/* Generado por Compilador: una funcion por expresion */\n#include <math.h>\n\n";
+    for (size_t i = 0; i < programas.size(); i++) emitirFuncionC(salida, programas[i], "expresion_" + to_string(i));
+}
+
+/* Compila una lista de expresiones y regresa sus programas. Las que tienen error se cuentan en
+'descartadas'; 'almacen' conserva el texto porque los literales del programa apuntan a el */
+vector<Programa> traducirExpresiones(const vector<string>& almacen, size_t& descartadas) {
+    vector<Programa> programas;
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    descartadas = 0;
+    for (const string& expresion : almacen) {
+        ctx.reiniciar();
+        ctx.entrada = expresion;
+        descartada.limpiar();
+        if (traducir(ctx)) programas.push_back(ctx.programa);
+        else descartadas++;
+    }
+    return programas;
+}
+
+// Lineas no vacias del archivo, o 'cantidad' expresiones generadas si no se da archivo
+bool leerExpresiones(const string& ruta, vector<string>& expresiones) {
+    if (ruta.empty()) {
+        ParametrosGenerador parametros;
+        parametros.tokens = 40;
+        GeneradorExpresiones generador(parametros);
+        for (size_t i = 0; i < 1000; i++) expresiones.push_back(generador.generar());
+        return true;
+    }
+    LectorLineas lector;
+    if (!lector.abrir(ruta)) {
+        cerr << "No se pudo abrir el archivo '" << ruta << "'\n";
+        return false;
+    }
+    string_view linea;
+    while (lector.siguiente(linea)) {
+        if (linea.find_first_not_of(' ') != string_view::npos) expresiones.emplace_back(linea);
+    }
+    return true;
+}
+
+// Compilador --emitir-c [archivo]: escribe en la salida estandar la unidad de C de cada expresion valida
+int emitirC(const string& ruta) {
+    vector<string> expresiones;
+    if (!leerExpresiones(ruta, expresiones)) return 1;
+    size_t descartadas = 0;
+    vector<Programa> programas = traducirExpresiones(expresiones, descartadas);
+    emitirUnidadC(cout, programas);
+    cerr << "Funciones emitidas: " << programas.size() << " (" << descartadas << " expresiones con error)\n";
+    return 0;
+}
+
+#if USAR_NATIVO
+/* Biblioteca compartida con el codigo nativo de un conjunto de programas. La unidad de C se
+escribe en un directorio temporal, se compila con $CC (cc por omision) y se carga con dlopen;
+al destruirse se descarga y se borran los archivos. No se usa -ffast-math y se desactiva la
+contraccion a FMA para que cada operacion redondee igual que en el interprete */
+class ModuloNativo {
+public:
+    using Funcion = int (*)(const float* variables, float* resultado);
+
+    ~ModuloNativo() {
+        if (biblioteca) dlclose(biblioteca);
+        if (!directorio.empty()) {
+            unlink((directorio + "/expresiones.c").c_str());
+            unlink((directorio + "/expresiones.so").c_str());
+            rmdir(directorio.c_str());
+        }
+    }
+
+    // Regresa falso con la causa en 'error' si no se pudo compilar o cargar
+    bool compilar(const vector<Programa>& programas, string& error) {
+        const char* temporal = getenv("TMPDIR");
+        string plantilla = string(temporal && *temporal ? temporal : "/tmp") + "/compiladorXXXXXX";
+        if (mkdtemp(&plantilla[0]) == nullptr) {
+            error = "no se pudo crear el directorio temporal";
+            return false;
+        }
+        directorio = plantilla;
+        string fuente = directorio + "/expresiones.c";
+        string objeto = directorio + "/expresiones.so";
+        {
+            ofstream archivo(fuente);
+            emitirUnidadC(archivo, programas);
+            if (!archivo) {
+                error = "no se pudo escribir " + fuente;
+                return false;
+            }
+        }
+
+        // $CC puede traer argumentos ("ccache gcc"); las rutas van aparte y no pasan por el shell
+        const char* compiladorC = getenv("CC");
+        vector<string> argumentos;
+        istringstream palabras(compiladorC && *compiladorC ? compiladorC : "cc");
+        for (string palabra; palabras >> palabra;) argumentos.push_back(palabra);
+        if (argumentos.empty()) argumentos.push_back("cc");
+        for (const char* opcion : { "-O2", "-fPIC", "-shared", "-ffp-contract=off", "-o" }) argumentos.push_back(opcion);
+        argumentos.push_back(objeto);
+        argumentos.push_back(fuente);
+        if (!ejecutar(argumentos)) {
+            error = "fallo el comando:";
+            for (const string& argumento : argumentos) error += " " + argumento;
+            return false;
+        }
+        biblioteca = dlopen(objeto.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (biblioteca == nullptr) {
+            error = dlerror();
+            return false;
+        }
+        funciones.clear();
+        for (size_t i = 0; i < programas.size(); i++) {
+            void* simbolo = dlsym(biblioteca, ("expresion_" + to_string(i)).c_str());
+            if (simbolo == nullptr) {
+                error = dlerror();
+                return false;
+            }
+            funciones.push_back(reinterpret_cast<Funcion>(simbolo));
+        }
+        return true;
+    }
+
+    Funcion funcion(size_t i) const { return funciones[i]; }
+
+private:
+    // Corre el programa argumentos[0] (buscado en el PATH) y regresa verdadero si termino con 0
+    static bool ejecutar(const vector<string>& argumentos) {
+        vector<char*> argv;
+        for (const string& argumento : argumentos) argv.push_back(const_cast<char*>(argumento.c_str()));
+        argv.push_back(nullptr);
+        pid_t hijo = fork();
+        if (hijo < 0) return false;
+        if (hijo == 0) {
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+        int estado;
+        while (waitpid(hijo, &estado, 0) < 0) {
+            if (errno != EINTR) return false;
+        }
+        return WIFEXITED(estado) && WEXITSTATUS(estado) == 0;
+    }
+
+    void* biblioteca = nullptr;
+    string directorio;
+    vector<Funcion> funciones;
+};
+
+/* Compilador --benchmark-nativo [archivo]: evalua las mismas expresiones con la maquina virtual
+y con el codigo nativo, revisa que den los mismos bits (o el mismo error) y escribe una linea
+JSON con los tiempos. Sin archivo usa 1000 expresiones generadas de 40 tokens. Las variables
+valen 1, 1.5, 2, ... en el orden de su tabla */
+int compararNativo(const string& ruta) {
+    const double TIEMPO_MINIMO = 0.5;
+    vector<string> expresiones;
+    if (!leerExpresiones(ruta, expresiones)) return 1;
+    size_t descartadas = 0;
+    vector<Programa> programas = traducirExpresiones(expresiones, descartadas);
+    if (programas.empty()) {
+        cerr << "No hay expresiones validas para medir\n";
+        return 1;
+    }
+
+    vector<CodigoBytes> codigos(programas.size());
+    MaquinaVirtual maquina;
+    size_t instrucciones = 0, maximoVariables = 0;
+    for (size_t i = 0; i < programas.size(); i++) {
+        compilarBytecode(programas[i], codigos[i]);
+        maquina.preparar(codigos[i]);
+        instrucciones += programas[i].instrucciones.size();
+        maximoVariables = max(maximoVariables, programas[i].variables.size());
+    }
+    vector<float> variables(maximoVariables);
+    for (size_t j = 0; j < variables.size(); j++) variables[j] = 1.0f + 0.5f * j;
+
+    auto inicio = chrono::steady_clock::now();
+    ModuloNativo modulo;
+    string error;
+    if (!modulo.compilar(programas, error)) {
+        cerr << "No se pudo generar el codigo nativo: " << error << "\n";
+        return 1;
+    }
+    double segundosCompilacion = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    size_t diferentes = 0;
+    for (size_t i = 0; i < programas.size(); i++) {
+        float interpretado = 0, nativo = 0;
+        int errorInterpretado = maquina.ejecutar(codigos[i], interpretado, variables.data());
+        int errorNativo = modulo.funcion(i)(variables.data(), &nativo);
+        bool iguales = errorInterpretado == errorNativo
+            && (errorInterpretado != 0 || memcmp(&interpretado, &nativo, sizeof(float)) == 0);
+        if (!iguales && diferentes++ < 5) {
+            cerr << "Resultado distinto en '" << expresiones[i] << "': " << interpretado << " contra " << nativo << "\n";
+        }
+    }
+
+    // La suma de resultados evita que el compilador quite las llamadas que se miden
+    float suma = 0;
+    size_t repeticiones = 0;
+    double segundosMaquina = medirRepetido([&] {
+        for (size_t i = 0; i < codigos.size(); i++) {
+            float resultado = 0;
+            maquina.ejecutar(codigos[i], resultado, variables.data());
+            suma += resultado;
+        }
+    }, TIEMPO_MINIMO, repeticiones);
+    double segundosNativo = medirRepetido([&] {
+        for (size_t i = 0; i < programas.size(); i++) {
+            float resultado = 0;
+            modulo.funcion(i)(variables.data(), &resultado);
+            suma += resultado;
+        }
+    }, TIEMPO_MINIMO, repeticiones);
+
+    double n = double(programas.size());
+    cout << "{\"expresiones\":" << programas.size() << ",\"descartadas\":" << descartadas
+         << ",\"instrucciones\":" << instrucciones << ",\"compilacion_s\":" << segundosCompilacion
+         << ",\"maquina_ns\":" << segundosMaquina * 1e9 / n << ",\"nativo_ns\":" << segundosNativo * 1e9 / n
+         << ",\"aceleracion\":" << segundosMaquina / segundosNativo << ",\"diferentes\":" << diferentes
+         << ",\"suma\":" << suma << "}\n";
+    return diferentes == 0 ? 0 : 1;
+}
+#endif
+
+/* Formato binario de expresiones compiladas (--guardar / --cargar). Todo es de tamaño fijo y
+esta alineado a 8 bytes, asi el archivo se mapea con mmap y cada arreglo se lee en su lugar,
+sin volver a pasar por el lexer ni el parser:
+  CabeceraArchivo
+  uint64_t desplazamiento[expresiones]   inicio de cada registro desde el principio del archivo
+  registro de cada expresion:
+    CabeceraExpresion
+    InstruccionBinaria[instrucciones]
+    float valores[constantes]
+    RangoTexto literales[constantes]     solo con SECCION_LITERALES (texto original de cada literal)
+    RangoTexto variables[variables]      nombres de las variables, en el orden de su tabla
+    uint8_t simbolo[nodos], hijos[nodos] solo con SECCION_ARBOL, en preorden; 'hijos' marca con un
+                                         bit cada hijo presente (izquierdo, medio, derecho)
+    RangoTexto textoArbol[hojasArbol]    texto de cada nodo Literal, en preorden
+    char texto[bytesTexto]               textos a los que apuntan los rangos
+Un cambio en el formato sube VERSION_BINARIO; un archivo de otra version no se carga */
+constexpr char MAGIA_BINARIO[4] = { 'C', 'E', 'X', 'P' };
+constexpr uint16_t VERSION_BINARIO = 1;
+constexpr uint16_t ORDEN_BYTES = 0x0102; // Se lee al reves si el archivo viene de otra arquitectura
+
+enum SeccionBinario : uint32_t {
+    SECCION_LITERALES = 1, // Texto de los literales y de la expresion original
+    SECCION_ARBOL = 2      // Arbol de parseo, para verlo sin volver a analizar
+};
+
+struct CabeceraArchivo {
+    char magia[4];
+    uint16_t version;
+    uint16_t orden;
+    uint32_t expresiones;
+    uint32_t secciones;
+};
+
+struct RangoTexto {
+    uint32_t inicio;
+    uint32_t longitud;
+};
+
+struct CabeceraExpresion {
+    uint32_t instrucciones;
+    uint32_t temporales;
+    uint32_t resultado;
+    uint32_t constantes;
+    uint32_t variables;
+    uint32_t nodos;
+    uint32_t hojasArbol;
+    uint32_t bytesTexto;
+    RangoTexto fuente; // Expresion original, vacia sin SECCION_LITERALES
+};
+
+struct InstruccionBinaria {
+    uint8_t op;
+    uint8_t tipo;
+    uint16_t relleno;
+    uint32_t destino;
+    uint32_t a;
+    uint32_t b;
+};
+static_assert(sizeof(CabeceraArchivo) == 16 && sizeof(CabeceraExpresion) == 40 && sizeof(InstruccionBinaria) == 16,
+              "El formato binario no debe depender del compilador");
+
+// Desplazamiento de cada arreglo dentro del registro de una expresion
+struct DistribucionRegistro {
+    size_t instrucciones, valores, literales, variables, simbolos, hijos, textoArbol, texto, fin;
+
+    DistribucionRegistro(const CabeceraExpresion& c, uint32_t secciones) {
+        auto alinear = [](size_t n) { return (n + 7) & ~size_t(7); };
+        instrucciones = sizeof(CabeceraExpresion);
+        valores = instrucciones + size_t(c.instrucciones) * sizeof(InstruccionBinaria);
+        literales = alinear(valores + size_t(c.constantes) * sizeof(float));
+        variables = literales + (secciones & SECCION_LITERALES ? size_t(c.constantes) * sizeof(RangoTexto) : 0);
+        simbolos = variables + size_t(c.variables) * sizeof(RangoTexto);
+        hijos = simbolos + c.nodos;
+        textoArbol = alinear(hijos + c.nodos);
+        texto = textoArbol + size_t(c.hojasArbol) * sizeof(RangoTexto);
+        fin = alinear(texto + c.bytesTexto);
+    }
+};
+
+/* Junta los registros de las expresiones conforme se compilan y los escribe en un archivo.
+Los textos se copian, asi el contexto se puede reutilizar para la siguiente expresion */
+class EscritorBinario {
+public:
+    explicit EscritorBinario(uint32_t secciones) : secciones(secciones) {}
+
+    // Agrega el programa del contexto (y su arbol con SECCION_ARBOL, que debe estar construido)
+    void agregar(const Contexto& ctx) {
+        const Programa& prog = ctx.programa;
+        texto.clear();
+        rangosLiterales.clear();
+        rangosVariables.clear();
+        simbolos.clear();
+        hijos.clear();
+        rangosArbol.clear();
+
+        CabeceraExpresion cabecera = {};
+        cabecera.instrucciones = uint32_t(prog.instrucciones.size());
+        cabecera.temporales = prog.temporales;
+        cabecera.resultado = prog.resultado;
+        cabecera.constantes = uint32_t(prog.valores.size());
+        cabecera.variables = uint32_t(prog.variables.size());
+        if (secciones & SECCION_LITERALES) {
+            cabecera.fuente = guardarTexto(ctx.entrada);
+            for (string_view literal : prog.literales) rangosLiterales.push_back(guardarTexto(literal));
+        }
+        for (string_view variable : prog.variables) rangosVariables.push_back(guardarTexto(variable));
+        if (secciones & SECCION_ARBOL) agregarArbol(ctx.arbol.raiz);
+        cabecera.nodos = uint32_t(simbolos.size());
+        cabecera.hojasArbol = uint32_t(rangosArbol.size());
+        cabecera.bytesTexto = uint32_t(texto.size());
+
+        DistribucionRegistro d(cabecera, secciones);
+        desplazamientos.push_back(registros.size());
+        size_t base = registros.size();
+        registros.resize(base + d.fin, 0);
+        char* r = registros.data() + base;
+        memcpy(r, &cabecera, sizeof(cabecera));
+        for (size_t i = 0; i < prog.instrucciones.size(); i++) {
+            const Instruccion& ins = prog.instrucciones[i];
+            InstruccionBinaria binaria = { uint8_t(ins.op), uint8_t(ins.tipo), 0, ins.destino, ins.a, ins.b };
+            memcpy(r + d.instrucciones + i * sizeof(binaria), &binaria, sizeof(binaria));
+        }
+        copiar(r + d.valores, prog.valores);
+        copiar(r + d.literales, rangosLiterales);
+        copiar(r + d.variables, rangosVariables);
+        copiar(r + d.simbolos, simbolos);
+        copiar(r + d.hijos, hijos);
+        copiar(r + d.textoArbol, rangosArbol);
+        copiar(r + d.texto, texto);
+    }
+
+    size_t expresiones() const { return desplazamientos.size(); }
+
+    // Escribe el archivo completo. Regresa los bytes escritos o 0 si no se pudo
+    size_t escribir(const string& ruta) const {
+        ofstream archivo(ruta, ios::binary);
+        size_t bytes = escribirEn(archivo);
+        archivo.close();
+        return archivo ? bytes : 0;
+    }
+
+    // Escribe el contenido del archivo en 'salida' y regresa cuantos bytes son
+    size_t escribirEn(ostream& salida) const {
+        CabeceraArchivo cabecera = {};
+        memcpy(cabecera.magia, MAGIA_BINARIO, sizeof(cabecera.magia));
+        cabecera.version = VERSION_BINARIO;
+        cabecera.orden = ORDEN_BYTES;
+        cabecera.expresiones = uint32_t(desplazamientos.size());
+        cabecera.secciones = secciones;
+        size_t inicioRegistros = sizeof(cabecera) + desplazamientos.size() * sizeof(uint64_t);
+        vector<uint64_t> indice(desplazamientos.size());
+        for (size_t i = 0; i < indice.size(); i++) indice[i] = inicioRegistros + desplazamientos[i];
+
+        salida.write(reinterpret_cast<const char*>(&cabecera), sizeof(cabecera));
+        salida.write(reinterpret_cast<const char*>(indice.data()), streamsize(indice.size() * sizeof(uint64_t)));
+        salida.write(registros.data(), streamsize(registros.size()));
+        return inicioRegistros + registros.size();
+    }
+
+private:
+    RangoTexto guardarTexto(string_view s) {
+        RangoTexto rango = { uint32_t(texto.size()), uint32_t(s.size()) };
+        texto.append(s);
+        return rango;
+    }
+
+    template <typename T>
+    static void copiar(char* destino, const T& origen) {
+        if (!origen.empty()) memcpy(destino, origen.data(), origen.size() * sizeof(origen[0]));
+    }
+
+    // Preorden con pila explicita, los hijos se apilan al reves para salir en orden
+    void agregarArbol(const Nodo* raiz) {
+        vector<const Nodo*> pila;
+        if (raiz) pila.push_back(raiz);
+        while (!pila.empty()) {
+            const Nodo* nodo = pila.back();
+            pila.pop_back();
+            simbolos.push_back(uint8_t(nodo->simbolo));
+            hijos.push_back(uint8_t((nodo->izquierdo ? 1 : 0) | (nodo->medio ? 2 : 0) | (nodo->derecho ? 4 : 0)));
+            if (nodo->simbolo == Simbolo::Literal) rangosArbol.push_back(guardarTexto(nodo->valor));
+            for (const Nodo* hijo : { nodo->derecho, nodo->medio, nodo->izquierdo }) {
+                if (hijo) pila.push_back(hijo);
             }
-            else {
-                size_t punto2 = val.find_first_of('.', punto + 1);
-                if (punto2 != string::npos) {
-                    errores(3); /*Si el numero tiene dos puntos manda error*/
-                }
-                else {
-                    size_t igual = operaciones[0].find_first_of('=');
-                    igual += 2;
-                    string temp = "";
-                    for (int i = igual; i < operaciones[0].size(); i++) {
-                        temp += operaciones[0][i];
-                    }
-                    for (int j = 0; j < igual; j++) {
-                        cout << operaciones[0][j];
-                    }
-                    cout << "to_float( " << temp << " )\n"; /*Si el numero tiene un solo 
-                    punto decimal convierte a flotante*/
-                    flotantes++;
-                    t[paso] = stof(temp);
-                }
+        }
+    }
+
+    uint32_t secciones;
+    vector<size_t> desplazamientos; // Dentro de 'registros'
+    vector<char> registros;
+    // Partes del registro de la expresion actual
+    string texto;
+    vector<RangoTexto> rangosLiterales, rangosVariables, rangosArbol;
+    vector<uint8_t> simbolos, hijos;
+};
+
+/* Archivo binario mapeado en memoria (leido completo donde no hay mmap). Cargar una expresion
+es copiar sus arreglos al programa, revisando que cada indice este dentro de su tabla; los
+literales y variables quedan como vistas al archivo, que debe seguir abierto mientras se usen */
+class ArchivoBinario {
+public:
+    ~ArchivoBinario() {
+#if USAR_MMAP
+        if (mapa) munmap(const_cast<char*>(mapa), tam);
+#endif
+    }
+
+    // Regresa un mensaje de error, vacio si el archivo se abrio y su cabecera es valida
+    string abrir(const string& ruta) {
+#if USAR_MMAP
+        int descriptor = open(ruta.c_str(), O_RDONLY);
+        if (descriptor < 0) return "No se pudo abrir el archivo '" + ruta + "'";
+        struct stat informacion;
+        if (fstat(descriptor, &informacion) == 0 && informacion.st_size > 0) {
+            void* direccion = mmap(nullptr, size_t(informacion.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (direccion != MAP_FAILED) {
+                mapa = static_cast<const char*>(direccion);
+                tam = size_t(informacion.st_size);
             }
         }
-        else {
-            // Si el paso contiene una operacion la realiza
-            size_t igual = operaciones[0].find_first_of('=');
-            size_t posT = operaciones[0].find_first_of('t', igual + 1);
-            posT += 2;
-            size_t posT2 = operaciones[0].find_first_of('t', posT);
-            posT2 += 2;
-            int indice = operaciones[0][posT] - '0';
-            int indice2 = operaciones[0][posT2] - '0';
-            char op = operaciones[0][posT + 3];
-            for (int j = 0; j < igual + 2; j++) {
-                cout << operaciones[0][j];
-            }
-            cout << t[indice] << " " << op << " " << t[indice2] << "\n";
-
-            // Manejo de operaciones
-            switch(op) {
-            case '+':
-                t[paso] = t[indice] + t[indice2];
-                break;
-            case '-':
-                t[paso] = t[indice] - t[indice2];
-                break;
-            case '*':
-                t[paso] = t[indice] * t[indice2];
-                break;
-            case '/':
-                if (t[indice2] == 0) {
-                    errores(4);
-                }
-                else {
-                    t[paso] = t[indice] / t[indice2];
-                }
-                break;
+        ::close(descriptor);
+#endif
+        if (!mapa) {
+            ifstream archivo(ruta, ios::binary);
+            if (!archivo) return "No se pudo abrir el archivo '" + ruta + "'";
+            copia.assign(istreambuf_iterator<char>(archivo), istreambuf_iterator<char>());
+            datos = copia.data();
+            tam = copia.size();
+        }
+        else datos = mapa;
+        return validarCabecera(ruta);
+    }
+
+    // Usa 'bytes' como el contenido del archivo, sin leer el disco (ver --probar binario)
+    string abrirMemoria(vector<char> bytes) {
+        copia = move(bytes);
+        datos = copia.data();
+        tam = copia.size();
+        return validarCabecera("(memoria)");
+    }
+
+    size_t expresiones() const { return cabecera.expresiones; }
+    uint32_t secciones() const { return cabecera.secciones; }
+    size_t bytes() const { return tam; }
+
+    // Llena el programa con la expresion 'i'. Regresa falso si el registro esta danado
+    bool cargar(size_t i, Programa& prog, string_view& fuente) const {
+        CabeceraExpresion c;
+        const char* r = registro(i, c);
+        if (!r) return false;
+        DistribucionRegistro d(c, cabecera.secciones);
+        // Cada temporal lo asigna alguna instruccion, asi un registro danado no pide un t[] enorme
+        if (c.instrucciones == 0 || c.temporales > c.instrucciones || c.resultado >= c.temporales) return false;
+
+        prog.limpiar();
+        prog.instrucciones.resize(c.instrucciones);
+        for (size_t k = 0; k < c.instrucciones; k++) {
+            InstruccionBinaria b;
+            memcpy(&b, r + d.instrucciones + k * sizeof(b), sizeof(b));
+            CodigoOp op = CodigoOp(b.op);
+            bool valida = b.op <= uint8_t(CodigoOp::Copia) && b.tipo <= uint8_t(TipoDato::Flotante) && b.destino < c.temporales;
+            if (op == CodigoOp::Cargar) valida = valida && b.a < c.constantes;
+            else if (op == CodigoOp::Variable) valida = valida && b.a < c.variables;
+            else valida = valida && b.a < c.temporales && (!esBinaria(op) || b.b < c.temporales);
+            if (!valida) return false;
+            prog.instrucciones[k] = { op, TipoDato(b.tipo), b.destino, b.a, b.b };
+        }
+        prog.valores.resize(c.constantes);
+        if (c.constantes) memcpy(prog.valores.data(), r + d.valores, size_t(c.constantes) * sizeof(float));
+        prog.literales.resize(c.constantes);
+        if (cabecera.secciones & SECCION_LITERALES) {
+            for (size_t k = 0; k < c.constantes; k++) {
+                if (!leerTexto(r, d, c, k, d.literales, prog.literales[k])) return false;
             }
         }
-        
-        operaciones.erase(operaciones.begin());
+        prog.variables.resize(c.variables);
+        for (size_t k = 0; k < c.variables; k++) {
+            if (!leerTexto(r, d, c, k, d.variables, prog.variables[k])) return false;
+        }
+        prog.temporales = c.temporales;
+        prog.resultado = c.resultado;
+        RangoTexto rango = c.fuente;
+        if (uint64_t(rango.inicio) + rango.longitud > c.bytesTexto) return false;
+        fuente = string_view(r + d.texto + rango.inicio, rango.longitud);
+        return true;
+    }
+
+    // Reconstruye el arbol de parseo de la expresion 'i'. Regresa falso si no se guardo o esta danado
+    bool cargarArbol(size_t i, ArbolTernario& arbol) const {
+        arbol.reiniciar();
+        CabeceraExpresion c;
+        const char* r = registro(i, c);
+        if (!r || !(cabecera.secciones & SECCION_ARBOL) || c.nodos == 0) return false;
+        DistribucionRegistro d(c, cabecera.secciones);
+        const uint8_t* simbolos = reinterpret_cast<const uint8_t*>(r + d.simbolos);
+        const uint8_t* hijos = reinterpret_cast<const uint8_t*>(r + d.hijos);
+
+        // Cada nodo del preorden es el siguiente hijo presente del nodo abierto mas reciente
+        vector<pair<Nodo*, uint8_t>> pila; // Nodo y los hijos que le faltan
+        size_t hoja = 0;
+        for (size_t k = 0; k < c.nodos; k++) {
+            if (simbolos[k] > uint8_t(Simbolo::Nulo) || hijos[k] > 7) return false;
+            Simbolo simbolo = Simbolo(simbolos[k]);
+            string_view literal;
+            if (simbolo == Simbolo::Literal && !leerTexto(r, d, c, hoja++, d.textoArbol, literal, c.hojasArbol)) return false;
+
+            Nodo** destino = &arbol.raiz;
+            Nodo* padre = nullptr;
+            if (k > 0) {
+                while (!pila.empty() && pila.back().second == 0) pila.pop_back();
+                if (pila.empty()) return false;
+                auto& [abierto, faltan] = pila.back();
+                int ranura = __builtin_ctz(faltan);
+                faltan &= uint8_t(faltan - 1);
+                padre = abierto;
+                destino = ranura == 0 ? &abierto->izquierdo : ranura == 1 ? &abierto->medio : &abierto->derecho;
+            }
+            arbol.insertar(simbolo, *destino, padre, literal);
+            if (hijos[k]) pila.push_back({ *destino, hijos[k] });
+        }
+        // A ningun nodo le deben faltar hijos
+        return all_of(pila.begin(), pila.end(), [](const auto& abierto) { return abierto.second == 0; });
+    }
+
+private:
+    // Regresa un mensaje de error, vacio si la cabecera de los datos es valida
+    string validarCabecera(const string& ruta) {
+        if (tam < sizeof(CabeceraArchivo)) return "El archivo '" + ruta + "' no es un binario de expresiones";
+        memcpy(&cabecera, datos, sizeof(cabecera));
+        if (memcmp(cabecera.magia, MAGIA_BINARIO, sizeof(cabecera.magia)) != 0) {
+            return "El archivo '" + ruta + "' no es un binario de expresiones";
+        }
+        if (cabecera.orden != ORDEN_BYTES) return "El archivo '" + ruta + "' es de una arquitectura con otro orden de bytes";
+        if (cabecera.version != VERSION_BINARIO) {
+            return "El archivo '" + ruta + "' es de la version " + to_string(cabecera.version) + " del formato, se esperaba la "
+                + to_string(VERSION_BINARIO);
+        }
+        if ((tam - sizeof(cabecera)) / sizeof(uint64_t) < cabecera.expresiones) return "El archivo '" + ruta + "' esta truncado";
+        return "";
     }
 
-    // Para el ultimo paso solo manda el resultado a raiz
-    size_t igual = operaciones[0].find_first_of('=');
-    size_t posT = operaciones[0].find_first_of('t', igual + 1);
-    posT += 2;
-    int indice = operaciones[0][posT] - '0';
-    for (int j = 0; j < igual + 2; j++) {
-        cout << operaciones[0][j];
+    // Registro de la expresion 'i' si cabe completo en el archivo
+    const char* registro(size_t i, CabeceraExpresion& c) const {
+        if (i >= cabecera.expresiones) return nullptr;
+        uint64_t desplazamiento;
+        memcpy(&desplazamiento, datos + sizeof(cabecera) + i * sizeof(uint64_t), sizeof(desplazamiento));
+        if (desplazamiento > tam || tam - desplazamiento < sizeof(c)) return nullptr;
+        memcpy(&c, datos + desplazamiento, sizeof(c));
+        if (DistribucionRegistro(c, cabecera.secciones).fin > tam - desplazamiento) return nullptr;
+        return datos + desplazamiento;
     }
-    if (flotantes > 0) {
-        cout << "to_float( " << t[indice] << " )\n";
+
+    // Texto del rango 'k' del arreglo que empieza en 'arreglo', con 'total' rangos como limite
+    static bool leerTexto(const char* r, const DistribucionRegistro& d, const CabeceraExpresion& c, size_t k, size_t arreglo,
+                          string_view& texto, size_t total = SIZE_MAX) {
+        if (k >= total) return false;
+        RangoTexto rango;
+        memcpy(&rango, r + arreglo + k * sizeof(rango), sizeof(rango));
+        if (uint64_t(rango.inicio) + rango.longitud > c.bytesTexto) return false;
+        texto = string_view(r + d.texto + rango.inicio, rango.longitud);
+        return true;
     }
-    else {
-        cout << "to_int( " << t[indice] << " )\n";
+
+    CabeceraArchivo cabecera = {};
+    const char* mapa = nullptr;
+    const char* datos = nullptr;
+    size_t tam = 0;
+    vector<char> copia; // Solo si no se pudo mapear
+};
+
+/* Compila cada expresion del archivo (o 1000 generadas) y guarda los programas validos en el
+formato binario, con las secciones opcionales que se pidan */
+int guardarBinario(const string& ruta, const string& entrada, uint32_t secciones) {
+    vector<string> expresiones;
+    if (!leerExpresiones(entrada, expresiones)) return 1;
+    EscritorBinario escritor(secciones);
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    size_t descartadas = 0;
+    auto inicio = chrono::steady_clock::now();
+    for (const string& expresion : expresiones) {
+        ctx.reiniciar();
+        ctx.entrada = expresion;
+        descartada.limpiar();
+        if (!traducir(ctx)) {
+            descartadas++;
+            continue;
+        }
+        if (secciones & SECCION_ARBOL) asegurarArbol(ctx);
+        escritor.agregar(ctx);
+    }
+    size_t bytes = escritor.escribir(ruta);
+    if (bytes == 0) {
+        cerr << "No se pudo escribir el archivo '" << ruta << "'\n";
+        return 1;
     }
-    
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    cerr << "Guardadas " << escritor.expresiones() << " expresiones (" << descartadas << " con error) en "
+         << bytes << " bytes, " << segundos * 1e3 << " ms\n";
+    return 0;
 }
 
-// Manejador de errores
-void errores(int error) {
-    switch (error) {
-    case 1:
-        cout << "Error 1.- Caracter '" << cadena[0] << "' NO valido\n";
-        exit(0);
-        break;
-    case 2:
-        cout << "Error 2.- Posible ambiguedad en la cadena ingresada\n";
-        exit(0);
-        break;
-    case 3:
-        cout << "Error 3.- Tipo de dato incorrecto\n";
-        exit(0);
-        break;
-    case 4:
-        cout << "Error 4.- Se intento dividir entre 0\n";
-        exit(0);
-        break;
-    default:
-        cout << "Error no identificado\n";
-        break;
+/* Carga todas las expresiones del archivo binario y las evalua con el evaluador de las opciones,
+imprimiendo las mismas secciones que el modo por lotes (salvo la tokenizacion, que no se guarda) */
+int cargarBinario(const string& ruta) {
+    auto inicio = chrono::steady_clock::now();
+    ArchivoBinario archivo;
+    string error = archivo.abrir(ruta);
+    if (!error.empty()) {
+        cerr << error << "\n";
+        return 1;
+    }
+    vector<Programa> programas(archivo.expresiones());
+    vector<string_view> fuentes(archivo.expresiones());
+    for (size_t i = 0; i < programas.size(); i++) {
+        if (!archivo.cargar(i, programas[i], fuentes[i])) {
+            cerr << "La expresion " << i << " del archivo '" << ruta << "' esta danada\n";
+            return 1;
+        }
+    }
+    double segundosCarga = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    Contexto ctx;
+    SalidaBuffer salida(SalidaBuffer::SALIDA_ESTANDAR);
+    ctx.salida = &salida;
+    vector<char> asignado;
+    size_t fallidas = 0;
+    inicio = chrono::steady_clock::now();
+    for (size_t i = 0; i < programas.size(); i++) {
+        ctx.reiniciar();
+        ctx.entrada = fuentes[i];
+        swap(ctx.programa, programas[i]);
+        salida.texto("== Expresion ").entero(i).texto(": ").texto(fuentes[i]).caracter('\n');
+        if (opciones.salida & SALIDA_IR) imprimirPrograma(salida, ctx.programa);
+
+        // Un programa guardado con --optimizar puede reutilizar temporales y la evaluacion paralela necesita uno por instruccion
+        bool asignacionUnica = true;
+        if (opciones.hilosEvaluacion > 0) {
+            asignado.assign(ctx.programa.temporales, 0);
+            for (const Instruccion& ins : ctx.programa.instrucciones) {
+                asignacionUnica = asignacionUnica && !asignado[ins.destino];
+                asignado[ins.destino] = 1;
+            }
+        }
+        if (asignacionUnica) evaluarPrograma(ctx);
+        else resolverOperacion(ctx);
+        if (ctx.error) fallidas++;
+        salida.caracter('\n');
+        salida.vaciarSiLleno();
     }
+    salida.vaciar();
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+    cerr << "Carga: " << programas.size() << " expresiones, " << archivo.bytes() << " bytes "
+         << (USAR_MMAP ? "mapeados" : "leidos") << " en " << segundosCarga * 1e3 << " ms\n";
+    cerr << "Evaluadas: " << programas.size() << " (" << fallidas << " con error) en " << segundos << " s\n";
+    return 0;
 }
 
-// Crear ventana y visulizar el arbol de parseo
-void verArbol(int argc, char** argv) {
-    // Inicializar OpenGL
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
-    glutInitWindowSize(800, 600);
-    glutCreateWindow("Arbol de Parseo");
+// Abre la ventana con el arbol de parseo de la expresion 'indice' guardado en el archivo binario
+int verArbolBinario(int argc, char** argv, const string& ruta, size_t indice) {
+    ArchivoBinario archivo; // Los textos del arbol apuntan al archivo, debe vivir mientras se ve
+    string error = archivo.abrir(ruta);
+    if (!error.empty()) {
+        cerr << error << "\n";
+        return 1;
+    }
+    if (!archivo.cargarArbol(indice, contexto.arbol)) {
+        cerr << "La expresion " << indice << " no existe o se guardo sin arbol (use --secciones arbol)\n";
+        return 1;
+    }
+    verArbol(argc, argv);
+    return 0;
+}
 
-    initOpenGL();
+/* Lee un archivo CSV cuya primera linea tiene los nombres de las columnas y el resto valores
+numericos. Regresa falso (con un mensaje en cerr) si el archivo no se puede leer */
+bool leerColumnas(const string& ruta, vector<string>& nombres, vector<vector<float>>& columnas) {
+    ifstream archivo(ruta);
+    if (!archivo) {
+        cerr << "No se pudo abrir el archivo '" << ruta << "'\n";
+        return false;
+    }
+    string linea;
+    size_t numeroLinea = 1;
+    if (!getline(archivo, linea)) return false;
+    if (!linea.empty() && linea.back() == '\r') linea.pop_back();
+    stringstream encabezado(linea);
+    string nombre;
+    while (getline(encabezado, nombre, ',')) {
+        size_t inicio = nombre.find_first_not_of(' ');
+        size_t fin = nombre.find_last_not_of(' ');
+        nombres.push_back(inicio == string::npos ? "" : nombre.substr(inicio, fin - inicio + 1));
+    }
+    columnas.assign(nombres.size(), vector<float>());
 
-    glutDisplayFunc(display); // Función de visualización
-    glutKeyboardFunc(teclado); // Función de manejo de teclado
+    while (getline(archivo, linea)) {
+        numeroLinea++;
+        if (linea.find_first_not_of(" \r") == string::npos) continue;
+        const char* p = linea.data();
+        const char* fin = p + linea.size();
+        if (fin > p && fin[-1] == '\r') fin--;
+        // Cada campo va hasta la siguiente coma; uno vacio, de mas o de menos es un error
+        for (size_t c = 0; c <= columnas.size(); c++) {
+            const char* coma = find(p, fin, ',');
+            const char* inicio = p;
+            const char* final = coma;
+            while (inicio < final && *inicio == ' ') inicio++;
+            while (final > inicio && final[-1] == ' ') final--;
+            float valor;
+            auto leido = from_chars(inicio, final, valor);
+            if (c == columnas.size() || leido.ec != errc() || leido.ptr != final) {
+                cerr << "Valor no numerico en la linea " << numeroLinea << " columna " << c + 1 << "\n";
+                return false;
+            }
+            columnas[c].push_back(valor);
+            if (coma == fin) {
+                if (c + 1 == columnas.size()) break;
+                cerr << "Valor no numerico en la linea " << numeroLinea << " columna " << c + 2 << "\n";
+                return false;
+            }
+            p = coma + 1;
+        }
+    }
+    return true;
+}
 
-    glutMainLoop(); // Ejecutar el bucle principal de OpenGL
+/* Compila una expresion con variables una sola vez y la evalua para cada fila del archivo,
+usando los nucleos SIMD. Las filas donde hubo division entre 0 reportan el error 4 sin
+detener el resto */
+int evaluarColumnas(const string& ruta, const string& expresion) {
+    vector<string> nombres;
+    vector<vector<float>> datos;
+    if (!leerColumnas(ruta, nombres, datos)) return 1;
+    size_t filas = datos.empty() ? 0 : datos[0].size();
+
+    // Los mensajes de compilacion van a cerr para dejar en la salida solo los resultados
+    Contexto ctx;
+    SalidaBuffer mensajes(SalidaBuffer::SALIDA_ERRORES);
+    ctx.salida = &mensajes;
+    ctx.entrada = expresion;
+    bool traducida = traducir(ctx);
+    mensajes.vaciar();
+    if (!traducida) return 1;
+
+    vector<const float*> columnas;
+    for (string_view variable : ctx.programa.variables) {
+        size_t indice = find(nombres.begin(), nombres.end(), variable) - nombres.begin();
+        if (indice == nombres.size()) {
+            ctx.detalleError = string(variable);
+            errores(ctx, 6);
+            return 1;
+        }
+        columnas.push_back(datos[indice].data());
+    }
+
+    const NucleosVectoriales& nucleos = seleccionarNucleos(opciones.simd);
+    vector<float> resultados(filas);
+    vector<uint8_t> divisionEntreCero(filas);
+    EvaluadorColumnas evaluador;
+    auto inicio = chrono::steady_clock::now();
+    evaluador.evaluar(ctx.programa, columnas, filas, resultados.data(), divisionEntreCero.data(), nucleos);
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    SalidaBuffer salida(SalidaBuffer::SALIDA_ESTANDAR);
+    for (size_t i = 0; i < filas; i++) {
+        if (divisionEntreCero[i]) salida.texto("Error 4.- Se intento dividir entre 0\n");
+        else salida.flotante(resultados[i]).caracter('\n');
+        salida.vaciarSiLleno();
+    }
+    salida.vaciar();
+    cerr << "Filas evaluadas: " << filas << " con nucleos " << nucleos.nombre << " en " << segundos << " s, "
+         << (segundos > 0 ? filas / segundos : 0) << " filas/s\n";
+    return 0;
+}
+
+/* Pruebas de equivalencia con entradas generadas (--probar). Cada una compara dos caminos que
+deben dar exactamente lo mismo sobre 'casos' entradas derivadas de la semilla, reporta las
+primeras diferencias en cerr y regresa cuantas hubo */
+
+// Registra una falla de la prueba; solo las primeras se describen para no llenar la salida
+void reportarFalla(const char* prueba, size_t caso, const string& detalle, size_t& fallas) {
+    if (fallas++ < 5) cerr << "Falla en " << prueba << ", caso " << caso << ": " << detalle << "\n";
+}
+
+// Cambia el divisor de una division del texto generado por 0, para probar tambien el error 4
+void dividirEntreCero(string& texto, mt19937_64& azar) {
+    size_t division = texto.find('/', azar() % texto.size());
+    if (division == string::npos) division = texto.find('/');
+    if (division == string::npos) return;
+    size_t inicio = texto.find_first_not_of('-', division + 1); // El generador solo divide entre literales
+    size_t fin = texto.find_first_not_of("0123456789.", inicio);
+    texto.replace(inicio, (fin == string::npos ? texto.size() : fin) - inicio, "0");
+}
+
+/* Evaluacion secuencial contra EvaluadorParalelo sobre arboles y DAGs generados, con umbrales
+pequeños para que salgan muchas tareas y 1 a 8 hilos. El mismo evaluador atiende todos los
+casos, asi tambien se prueba que su grupo de hilos despierte y se duerma entre evaluaciones.
+Al final revisa la compuerta de EvaluadorParalelo::conviene */
+size_t probarParalelo(const ParametrosGenerador& base, size_t casos) {
+    const size_t HILOS[] = { 1, 2, 3, 4, 8 };
+    mt19937_64 azar(base.semilla);
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    EvaluadorParalelo evaluador;
+    vector<float> esperado, t;
+    size_t fallas = 0;
+    for (size_t caso = 0; caso < casos; caso++) {
+        ParametrosGenerador p = base;
+        p.semilla = azar();
+        p.tokens = 20 + azar() % 20000;
+        p.profundidad = int(azar() % 6);
+        p.parentesis = double(azar() % 50) / 100;
+        GeneradorExpresiones generador(p);
+        ctx.reiniciar();
+        descartada.limpiar();
+        ctx.almacen = generador.generar();
+        if (azar() % 4 == 0) dividirEntreCero(ctx.almacen, azar);
+        ctx.entrada = ctx.almacen;
+        if (!traducir(ctx)) {
+            reportarFalla("paralelo", caso, "error " + to_string(ctx.error) + " al traducir", fallas);
+            continue;
+        }
+        // La mitad de los casos se vuelve un DAG con subexpresiones comunes (sin plegar, que lo dejaria en una constante)
+        Programa& prog = ctx.programa;
+        if (caso % 2) {
+            eliminarSubexpresionesComunes(prog);
+            propagarCopias(prog);
+            eliminarTemporalesMuertos(prog);
+        }
+        int errorSecuencial = evaluarSecuencial(prog, esperado);
+        size_t umbral = 1 + azar() % 256;
+        size_t hilos = HILOS[azar() % size(HILOS)];
+        evaluador.particionar(prog, umbral);
+        int error = evaluador.evaluar(prog, hilos, t);
+        bool iguales = error == errorSecuencial
+            && (error != 0 || (t.size() == esperado.size() && memcmp(t.data(), esperado.data(), t.size() * sizeof(float)) == 0));
+        if (!iguales) {
+            reportarFalla("paralelo", caso, to_string(prog.instrucciones.size()) + " instrucciones, umbral " + to_string(umbral)
+                          + ", " + to_string(hilos) + " hilos, error " + to_string(error) + " contra " + to_string(errorSecuencial),
+                          fallas);
+        }
+    }
+
+    // Nunca se parte con un hilo, con menos de dos tareas o para una sola evaluacion; si no, solo con varios nucleos
+    bool variosNucleos = thread::hardware_concurrency() >= 2;
+    if (EvaluadorParalelo::conviene(1 << 20, 4096, 1, 1 << 20) || EvaluadorParalelo::conviene(2 * 4096 - 1, 4096, 8, 1 << 20)
+        || EvaluadorParalelo::conviene(1 << 20, 4096, 8, 1) || EvaluadorParalelo::conviene(1 << 20, 4096, 8, 1 << 20) != variosNucleos) {
+        reportarFalla("paralelo", casos, "la compuerta de conviene no coincide", fallas);
+    }
+    return fallas;
+}
+
+/* lexerEscalar contra lexerMascaras con cada clasificador disponible sobre entradas de 0 a 300
+bytes (varios bloques de 64): expresiones generadas con bytes cambiados, texto al azar del
+alfabeto del lexer con tramos largos de digitos, letras y puntos que cruzan bloques, y bytes
+cualesquiera. lexerMascaras debe aceptar exactamente las entradas sin error de lexerEscalar,
+con los mismos tokens, y rechazar las demas sin dejar tokens */
+size_t probarLexer(const ParametrosGenerador& base, size_t casos) {
+    const char ALFABETO[] = "0123456789.abcxyzXYZ_+-*/() \t";
+    mt19937_64 azar(base.semilla);
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    vector<const ClasificadorCaracteres*> clasificadores = clasificadoresDisponibles();
+    vector<Token> esperados;
+    string entrada;
+    size_t fallas = 0;
+    for (size_t caso = 0; caso < casos; caso++) {
+        size_t largo = azar() % 301;
+        entrada.clear();
+        switch (caso % 3) {
+        case 0: {
+            ParametrosGenerador p = base;
+            p.semilla = azar();
+            p.tokens = 1 + largo / 3;
+            entrada = GeneradorExpresiones(p).generar();
+            for (size_t cambios = azar() % 3; cambios > 0 && !entrada.empty(); cambios--) {
+                entrada[azar() % entrada.size()] = ALFABETO[azar() % (sizeof(ALFABETO) - 1)];
+            }
+            break;
+        }
+        case 1:
+            while (entrada.size() < largo) {
+                char c = ALFABETO[azar() % (sizeof(ALFABETO) - 1)];
+                entrada.append(azar() % 8 == 0 ? 1 + azar() % 80 : 1, c);
+            }
+            entrada.resize(largo);
+            break;
+        default:
+            for (size_t i = 0; i < largo; i++) {
+                entrada += azar() % 4 ? ALFABETO[azar() % (sizeof(ALFABETO) - 1)] : char(azar() % 256);
+            }
+        }
+
+        ctx.reiniciar();
+        descartada.limpiar();
+        ctx.entrada = entrada;
+        lexerEscalar(ctx, entrada);
+        bool valida = ctx.error == 0;
+        esperados = ctx.cadena;
+        for (const ClasificadorCaracteres* clasificador : clasificadores) {
+            ctx.cadena.clear();
+            bool aceptada = lexerMascaras(ctx, entrada, *clasificador);
+            bool iguales = aceptada == valida && (aceptada ? mismosTokens(ctx.cadena, esperados) : ctx.cadena.empty());
+            if (!iguales) {
+                reportarFalla("lexer", caso, string("clasificador ") + clasificador->nombre + (valida ? ", valida" : ", no valida")
+                              + ", entrada '" + entrada + "'", fallas);
+            }
+        }
+    }
+    return fallas;
+}
+
+/* reutilizarTemporales no debe cambiar resultados: cada caso se optimiza con los pases de
+optimizarPrograma y se evalua con y sin la reutilizacion, con algunos literales cambiados por
+variables para que el plegado no lo deje en una constante. Sin eliminar subexpresiones comunes
+el programa sigue siendo un arbol y debe quedar con tantos temporales como su numero de
+Sethi–Ullman. Al final revisa que la cadena x*(x*(...)) de 3000 niveles baje de 3001 a 2 */
+size_t probarReutilizacion(const ParametrosGenerador& base, size_t casos) {
+    const float VARIABLES[] = { 1.5f, -2.25f, 3.0f };
+    mt19937_64 azar(base.semilla);
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    vector<float> esperado, t;
+    vector<uint32_t> etiqueta;
+    size_t fallas = 0;
+
+    // Los pases anteriores a la reutilizacion; sin 'subexpresiones' el programa sigue siendo un arbol
+    auto optimizar = [](Programa& prog, bool subexpresiones) {
+        plegarConstantes(prog);
+        if (subexpresiones) eliminarSubexpresionesComunes(prog);
+        propagarCopias(prog);
+        eliminarTemporalesMuertos(prog);
+    };
+    // Evalua con y sin reutilizacion y regresa cuantos temporales quedaron, o 0 si los resultados difieren
+    auto comparar = [&](Programa& prog) -> uint32_t {
+        int errorEsperado = evaluarSecuencial(prog, esperado, VARIABLES);
+        uint32_t resultado = prog.resultado;
+        reutilizarTemporales(prog);
+        int error = evaluarSecuencial(prog, t, VARIABLES);
+        bool iguales = error == errorEsperado
+            && (error != 0 || memcmp(&t[prog.resultado], &esperado[resultado], sizeof(float)) == 0);
+        return iguales ? prog.temporales : 0;
+    };
+
+    for (size_t caso = 0; caso < casos; caso++) {
+        ParametrosGenerador p = base;
+        p.semilla = azar();
+        p.tokens = 1 + azar() % 2000;
+        p.profundidad = int(azar() % 8);
+        p.parentesis = double(azar() % 60) / 100;
+        ctx.reiniciar();
+        descartada.limpiar();
+        ctx.almacen = GeneradorExpresiones(p).generar();
+        if (azar() % 4 == 0) dividirEntreCero(ctx.almacen, azar);
+        string& texto = ctx.almacen;
+        for (size_t i = 0; i < texto.size();) {
+            size_t fin = texto.find_first_not_of("0123456789.", i);
+            if (fin == string::npos) fin = texto.size();
+            if (fin > i && texto[i] != '0' && azar() % 3 == 0) {
+                texto.replace(i, fin - i, 1, char('x' + azar() % 3));
+                fin = i + 1;
+            }
+            i = max(fin, i + 1);
+        }
+        ctx.entrada = texto;
+        if (!traducir(ctx)) {
+            reportarFalla("reutilizar", caso, "error " + to_string(ctx.error) + " al traducir", fallas);
+            continue;
+        }
+        Programa& prog = ctx.programa;
+        bool arbol = caso % 2 == 0;
+        optimizar(prog, !arbol);
+
+        // Numero de Sethi–Ullman del programa con un temporal por instruccion
+        etiqueta.assign(prog.temporales, 0);
+        for (const Instruccion& ins : prog.instrucciones) {
+            uint32_t& e = etiqueta[ins.destino];
+            if (ins.op == CodigoOp::Cargar || ins.op == CodigoOp::Variable) e = 1;
+            else if (ins.op == CodigoOp::Negacion || ins.op == CodigoOp::Copia) e = etiqueta[ins.a];
+            else e = etiqueta[ins.a] == etiqueta[ins.b] ? etiqueta[ins.a] + 1 : max(etiqueta[ins.a], etiqueta[ins.b]);
+        }
+        uint32_t sethiUllman = etiqueta[prog.resultado];
+        uint32_t antes = prog.temporales;
+        uint32_t despues = comparar(prog);
+        if (despues == 0 || despues > antes) {
+            reportarFalla("reutilizar", caso, "los resultados cambiaron, expresion '" + texto + "'", fallas);
+        }
+        else if (arbol && despues != sethiUllman) {
+            reportarFalla("reutilizar", caso, to_string(despues) + " temporales, Sethi–Ullman " + to_string(sethiUllman)
+                          + ", expresion '" + texto + "'", fallas);
+        }
+    }
+
+    // Una cadena de multiplicaciones anidadas por la derecha: x queda vivo y el resto en un solo temporal
+    ctx.reiniciar();
+    for (int i = 0; i < 3000; i++) ctx.almacen += "x*(";
+    ctx.almacen += 'x';
+    ctx.almacen.append(3000, ')');
+    ctx.entrada = ctx.almacen;
+    if (!traducir(ctx)) {
+        reportarFalla("reutilizar", casos, "la cadena x*(x*(...)) no se tradujo", fallas);
+        return fallas;
+    }
+    optimizar(ctx.programa, true);
+    uint32_t antes = ctx.programa.temporales;
+    uint32_t despues = comparar(ctx.programa);
+    if (antes != 3001 || despues != 2) {
+        reportarFalla("reutilizar", casos, "la cadena x*(x*(...)) quedo de " + to_string(antes) + " a " + to_string(despues)
+                      + " temporales, se esperaba de 3001 a 2", fallas);
+    }
+    return fallas;
+}
+
+/* Cargador del formato binario contra archivos danados. Se guardan expresiones generadas (con
+variables, optimizadas o no, con y sin las secciones opcionales) y primero se revisa que el
+archivo intacto cargue los mismos programas y arboles. Despues cada caso trunca el archivo o
+cambia bytes o campos de 32 bits al azar: abrir, cargar y cargarArbol deben rechazarlo o
+regresar un programa cuyos indices esten dentro de sus tablas y cuyos textos esten dentro del
+archivo, que luego se imprime y se evalua. Conviene correrla compilada con -fsanitize=address */
+size_t probarBinario(const ParametrosGenerador& base, size_t casos) {
+    const size_t EXPRESIONES = 24;
+    mt19937_64 azar(base.semilla);
+    Contexto ctx;
+    SalidaBuffer descartada;
+    ctx.salida = &descartada;
+    size_t fallas = 0;
+
+    // Dos archivos: sin secciones opcionales y con ambas (el segundo con los programas optimizados)
+    const uint32_t SECCIONES[] = { 0, SECCION_LITERALES | SECCION_ARBOL };
+    vector<char> imagenes[2];
+    vector<string> fuentes;
+    vector<Programa> originales[2];
+    vector<pair<size_t, int>> arboles; // Nodos y altura del arbol de cada expresion
+    for (size_t i = 0; i < EXPRESIONES; i++) {
+        ParametrosGenerador p = base;
+        p.semilla = azar();
+        p.tokens = 1 + azar() % 120;
+        string texto = GeneradorExpresiones(p).generar();
+        for (size_t k = 0; k < texto.size(); k++) {
+            if (isdigit((unsigned char)texto[k]) && (k == 0 || !(isdigit((unsigned char)texto[k - 1]) || texto[k - 1] == '.')) && azar() % 4 == 0) {
+                size_t fin = texto.find_first_not_of("0123456789.", k);
+                texto.replace(k, (fin == string::npos ? texto.size() : fin) - k, 1, char('x' + azar() % 3));
+            }
+        }
+        fuentes.push_back(texto);
+    }
+    for (int archivo = 0; archivo < 2; archivo++) {
+        EscritorBinario escritor(SECCIONES[archivo]);
+        for (const string& fuente : fuentes) {
+            ctx.reiniciar();
+            descartada.limpiar();
+            ctx.entrada = fuente;
+            if (!traducir(ctx)) {
+                reportarFalla("binario", 0, "error " + to_string(ctx.error) + " al traducir '" + fuente + "'", fallas);
+                return fallas;
+            }
+            if (archivo == 1) {
+                plegarConstantes(ctx.programa);
+                eliminarSubexpresionesComunes(ctx.programa);
+                propagarCopias(ctx.programa);
+                eliminarTemporalesMuertos(ctx.programa);
+                reutilizarTemporales(ctx.programa);
+                asegurarArbol(ctx);
+                arboles.push_back({ ctx.arbol.nodos, ctx.arbol.altura(ctx.arbol.raiz) });
+            }
+            escritor.agregar(ctx);
+            originales[archivo].push_back(ctx.programa);
+        }
+        ostringstream salida;
+        escritor.escribirEn(salida);
+        string bytes = salida.str();
+        imagenes[archivo].assign(bytes.begin(), bytes.end());
+    }
+
+    // El archivo intacto debe dar exactamente lo que se guardo
+    for (int archivo = 0; archivo < 2; archivo++) {
+        ArchivoBinario binario;
+        string error = binario.abrirMemoria(imagenes[archivo]);
+        bool iguales = error.empty() && binario.expresiones() == EXPRESIONES;
+        for (size_t i = 0; iguales && i < EXPRESIONES; i++) {
+            Programa prog;
+            string_view fuente;
+            const Programa& original = originales[archivo][i];
+            iguales = binario.cargar(i, prog, fuente) && prog.temporales == original.temporales && prog.resultado == original.resultado
+                && prog.instrucciones.size() == original.instrucciones.size()
+                && equal(prog.instrucciones.begin(), prog.instrucciones.end(), original.instrucciones.begin(),
+                         [](const Instruccion& a, const Instruccion& b) {
+                             return a.op == b.op && a.tipo == b.tipo && a.destino == b.destino && a.a == b.a
+                                 && (!esBinaria(a.op) || a.b == b.b);
+                         })
+                && prog.valores.size() == original.valores.size()
+                && memcmp(prog.valores.data(), original.valores.data(), prog.valores.size() * sizeof(float)) == 0
+                && prog.variables == original.variables;
+            if (iguales && archivo == 1) {
+                iguales = fuente == fuentes[i] && prog.literales == original.literales && binario.cargarArbol(i, ctx.arbol)
+                    && ctx.arbol.nodos == arboles[i].first && ctx.arbol.altura(ctx.arbol.raiz) == arboles[i].second;
+            }
+            if (!iguales) reportarFalla("binario", 0, "la expresion " + to_string(i) + " no se cargo igual que se guardo", fallas);
+        }
+        if (!error.empty()) reportarFalla("binario", 0, error, fallas);
+    }
+
+    vector<float> t, variables;
+    for (size_t caso = 0; caso < casos; caso++) {
+        vector<char> bytes = imagenes[azar() % 2];
+        switch (azar() % 4) {
+        case 0: // Truncado
+            bytes.resize(azar() % bytes.size());
+            break;
+        case 1: // Bytes cambiados
+            for (size_t cambios = 1 + azar() % 8; cambios > 0; cambios--) bytes[azar() % bytes.size()] = char(azar());
+            break;
+        default: { // Campos de 32 bits (conteos, indices, rangos) con valores extremos; a veces tambien truncado
+            const uint32_t EXTREMOS[] = { 0, 1, 2, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF, 0xFFFFFFF0 };
+            for (size_t cambios = 1 + azar() % 4; cambios > 0; cambios--) {
+                uint32_t valor = azar() % 2 ? EXTREMOS[azar() % size(EXTREMOS)] : uint32_t(azar() % 64);
+                size_t posicion = (azar() % (bytes.size() / 4)) * 4;
+                memcpy(bytes.data() + posicion, &valor, sizeof(valor));
+            }
+            if (azar() % 4 == 0) bytes.resize(bytes.size() - 1 - azar() % min<size_t>(bytes.size() - 1, 64));
+        }
+        }
+
+        // Al moverse el vector conserva su memoria, asi los textos deben apuntar dentro de [inicio, fin)
+        const char* inicio = bytes.data();
+        const char* fin = inicio + bytes.size();
+        ArchivoBinario binario;
+        if (!binario.abrirMemoria(move(bytes)).empty()) continue;
+        auto dentro = [&](string_view texto) {
+            return texto.empty() || (texto.data() >= inicio && texto.data() + texto.size() <= fin);
+        };
+        for (size_t i = 0; i < min<size_t>(binario.expresiones(), 2 * EXPRESIONES); i++) {
+            Programa prog;
+            string_view fuente;
+            if (binario.cargar(i, prog, fuente)) {
+                bool valido = prog.temporales <= prog.instrucciones.size() && prog.resultado < prog.temporales
+                    && prog.literales.size() == prog.valores.size() && dentro(fuente)
+                    && all_of(prog.literales.begin(), prog.literales.end(), dentro)
+                    && all_of(prog.variables.begin(), prog.variables.end(), dentro);
+                for (const Instruccion& ins : prog.instrucciones) {
+                    valido = valido && ins.destino < prog.temporales;
+                    if (ins.op == CodigoOp::Cargar) valido = valido && ins.a < prog.valores.size();
+                    else if (ins.op == CodigoOp::Variable) valido = valido && ins.a < prog.variables.size();
+                    else valido = valido && ins.a < prog.temporales && (!esBinaria(ins.op) || ins.b < prog.temporales);
+                }
+                if (!valido) {
+                    reportarFalla("binario", caso, "la expresion " + to_string(i) + " se cargo con indices o textos fuera de sus tablas", fallas);
+                    continue;
+                }
+                descartada.limpiar();
+                imprimirPrograma(descartada, prog);
+                variables.assign(prog.variables.size(), 1.0f);
+                evaluarSecuencial(prog, t, variables.data());
+            }
+            if (binario.cargarArbol(i, ctx.arbol)) ctx.arbol.altura(ctx.arbol.raiz);
+        }
+    }
+    return fallas;
+}
+
+/* Ejecuta las pruebas con el nombre dado (o todas) y escribe una linea JSON por prueba. Con
+'casos' en 0 cada una usa su cantidad por omision. Regresa 1 si alguna fallo */
+int ejecutarPruebas(const string& nombre, size_t casos, const ParametrosGenerador& parametros) {
+    struct Prueba {
+        const char* nombre;
+        size_t (*ejecutar)(const ParametrosGenerador&, size_t);
+        size_t casos;
+    };
+    static const Prueba pruebas[] = {
+        { "paralelo", probarParalelo, 400 },
+        { "lexer", probarLexer, 300000 },
+        { "reutilizar", probarReutilizacion, 4000 },
+        { "binario", probarBinario, 20000 },
+    };
 
+    bool encontrada = false, todasPasaron = true;
+    for (const Prueba& prueba : pruebas) {
+        if (nombre != "todas" && nombre != prueba.nombre) continue;
+        encontrada = true;
+        size_t cantidad = casos ? casos : prueba.casos;
+        auto inicio = chrono::steady_clock::now();
+        size_t fallas = prueba.ejecutar(parametros, cantidad);
+        double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        todasPasaron &= fallas == 0;
+        cout << "{\"prueba\":\"" << prueba.nombre << "\",\"casos\":" << cantidad << ",\"fallas\":" << fallas
+             << ",\"segundos\":" << segundos << "}\n";
+    }
+    if (!encontrada) {
+        cerr << "Prueba '" << nombre << "' no valida, use";
+        for (const Prueba& prueba : pruebas) cerr << " " << prueba.nombre;
+        cerr << " o todas\n";
+        return 1;
+    }
+    return todasPasaron ? 0 : 1;
 }
 
 // Función principal
 int main(int argc, char** argv) {
-    string entrada;
-    vector <int> listaErrores;
-    cout << "Ingrese la cadena: ";
-    getline(cin, entrada);
-    
-    lexer(entrada); // Tokenizar cadena
+    // Separar las opciones generales de los argumentos que eligen el modo
+    vector<string> argumentos;
+    for (int i = 1; i < argc; i++) {
+        string argumento = argv[i];
+        // Lee el valor numerico de la opcion actual, con un mensaje de uso si no es valido
+        auto leerValor = [&](size_t& valor) {
+            const char* texto = argv[++i];
+            if (leerNumero(string_view(texto), valor)) return true;
+            cerr << "Valor no valido para " << argumento << ": '" << texto << "', se espera un entero no negativo\n";
+            return false;
+        };
+        if (argumento == "--optimizar") {
+            opciones.optimizar = true;
+        }
+        else if (argumento == "--vm") {
+            opciones.maquinaVirtual = true;
+        }
+        else if (argumento == "--traza") {
+            opciones.traza = true;
+        }
+        else if (argumento == "--repetir" && i + 1 < argc) {
+            if (!leerValor(opciones.repeticiones)) return 1;
+        }
+        else if (argumento == "--hilos" && i + 1 < argc) {
+            if (!leerValor(opciones.hilos)) return 1;
+            if (opciones.hilos == 0) opciones.hilos = max(1u, thread::hardware_concurrency());
+        }
+        else if (argumento == "--stats") {
+            opciones.estadisticas = true;
+            contarMemoria = true;
+        }
+        else if (argumento == "--cache" && i + 1 < argc) {
+            if (!leerValor(opciones.cacheMegas)) return 1;
+        }
+        else if (argumento == "--cache-parametrica") {
+            opciones.cacheParametrica = true;
+        }
+        else if (argumento == "--arbol") {
+            opciones.arbol = true;
+        }
+        else if (argumento == "--paralelo" && i + 1 < argc) {
+            if (!leerValor(opciones.hilosEvaluacion)) return 1;
+            if (opciones.hilosEvaluacion == 0) opciones.hilosEvaluacion = max(1u, thread::hardware_concurrency());
+        }
+        else if (argumento == "--umbral" && i + 1 < argc) {
+            if (!leerValor(opciones.umbral)) return 1;
+            opciones.umbral = max<size_t>(1, opciones.umbral);
+        }
+        else if (argumento == "--sin-reutilizar") {
+            opciones.reutilizar = false;
+        }
+        else if (argumento == "--simd" && i + 1 < argc) {
+            opciones.simd = argv[++i];
+            if (opciones.simd != "escalar" && opciones.simd != "sse" && opciones.simd != "avx2") {
+                cerr << "Valor no valido para --simd: '" << opciones.simd << "', use escalar, sse o avx2\n";
+                return 1;
+            }
+        }
+        else if (argumento == "--salida" && i + 1 < argc) {
+            if (!leerSecciones(argv[++i], opciones.salida)) {
+                cerr << "Secciones de salida no validas, use tokens, ir, traza y resultado separadas por comas\n";
+                return 1;
+            }
+        }
+        else {
+            argumentos.push_back(argumento);
+        }
+    }
+    string modo = argumentos.empty() ? "" : argumentos[0];
+    clasificadorLexer = &seleccionarClasificador(opciones.simd);
+    // La evaluacion paralela saca las dependencias de los temporales, necesita uno por instruccion
+    if (modo == "--benchmark-paralelo") opciones.reutilizar = false;
+    cacheProgramas.configurar(opciones.cacheMegas << 20, opciones.cacheParametrica);
 
-    // Si no hay errores en la cadena imprime la tokenizacion
-    cout << "Cadena Tokenizada: ";
-    for (int i = 0; i < cadena.size(); i++) {
-        cout << cadena[i] << " ";
+    // Lee el argumento numerico del modo en la posicion k si se dio (los que empiezan con - son parametros)
+    auto leerArgumento = [&](size_t k, size_t& valor) {
+        if (argumentos.size() <= k || argumentos[k][0] == '-') return true;
+        if (leerNumero(argumentos[k], valor)) return true;
+        cerr << "Argumento no valido para " << modo << ": '" << argumentos[k] << "', se espera un entero no negativo\n";
+        return false;
+    };
+
+    // Compilador --lote [archivo]: una expresion por linea, sin abrir ventanas
+    if (modo == "--lote") {
+        return procesarLote(argumentos.size() > 1 ? argumentos[1] : "-");
+    }
+    // Compilador --servidor [socket]: atiende expresiones por la entrada estandar o por un socket Unix
+    if (modo == "--servidor") {
+#if USAR_SOCKETS
+        if (argumentos.size() > 1) return servirSocket(argumentos[1]);
+#endif
+        servir(cin, cout);
+        cacheProgramas.reportar(cerr);
+        return 0;
+    }
+#if USAR_SOCKETS
+    // Compilador --comparar-servidor [solicitudes] [tokens]: latencia del servidor contra un proceso por expresion
+    if (modo == "--comparar-servidor") {
+        size_t solicitudes = 1000, tokens = 20;
+        if (!leerArgumento(1, solicitudes) || !leerArgumento(2, tokens)) return 1;
+        if (solicitudes == 0) {
+            cerr << "Argumento no valido para " << modo << ": '0', se espera al menos una solicitud\n";
+            return 1;
+        }
+        return compararServidor(argv[0], solicitudes, tokens);
+    }
+#endif
+    // Compilador --columnas datos.csv "expresion": evalua la expresion una vez por fila del archivo
+    if (modo == "--columnas" && argumentos.size() > 2) {
+        return evaluarColumnas(argumentos[1], argumentos[2]);
+    }
+    // Compilador --benchmark [tokens] [--semilla S ...]: tiempo de cada fase en lineas JSON
+    if (modo == "--benchmark" || modo == "--generar") {
+        ParametrosGenerador parametros;
+        size_t tokens = 0;
+        if (!leerArgumento(1, tokens)) return 1;
+        if (!leerParametrosGenerador(argumentos, tokens ? 2 : 1, parametros)) {
+            cerr << "Parametros del generador no validos\n";
+            return 1;
+        }
+        if (modo == "--benchmark") return ejecutarBenchmark(parametros, tokens ? tokens : 1000000);
+
+        // Compilador --generar [tokens] [--cantidad N ...]: imprime expresiones para el modo por lotes
+        parametros.tokens = tokens ? tokens : 20;
+        GeneradorExpresiones generador(parametros);
+        for (size_t i = 0; i < parametros.cantidad; i++) cout << generador.generar() << "\n";
+        return 0;
+    }
+    // Compilador --benchmark-lexer [MB] [--semilla S ...]: GB/s del lexer escalar contra el de mascaras
+    if (modo == "--benchmark-lexer") {
+        ParametrosGenerador parametros;
+        size_t megas = 0;
+        if (!leerArgumento(1, megas)) return 1;
+        if (!leerParametrosGenerador(argumentos, megas ? 2 : 1, parametros)) {
+            cerr << "Parametros del generador no validos\n";
+            return 1;
+        }
+        return ejecutarBenchmarkLexer(parametros, megas ? megas : 16);
+    }
+    // Compilador --benchmark-paralelo [tokens] [--semilla S ...]: evaluacion secuencial contra paralela
+    if (modo == "--benchmark-paralelo") {
+        ParametrosGenerador parametros;
+        size_t tokens = 0;
+        if (!leerArgumento(1, tokens)) return 1;
+        if (!leerParametrosGenerador(argumentos, tokens ? 2 : 1, parametros)) {
+            cerr << "Parametros del generador no validos\n";
+            return 1;
+        }
+        parametros.tokens = tokens ? tokens : 1000000;
+        return ejecutarBenchmarkParalelo(parametros);
+    }
+    // Compilador --probar [prueba] [casos] [--semilla S ...]: pruebas de equivalencia con entradas generadas
+    if (modo == "--probar") {
+        size_t k = 1;
+        string prueba = "todas";
+        if (argumentos.size() > k && !isdigit((unsigned char)argumentos[k][0]) && argumentos[k][0] != '-') prueba = argumentos[k++];
+        size_t casos = 0;
+        if (!leerArgumento(k, casos)) return 1;
+        if (argumentos.size() > k && argumentos[k][0] != '-') k++;
+        ParametrosGenerador parametros;
+        if (!leerParametrosGenerador(argumentos, k, parametros)) {
+            cerr << "Parametros del generador no validos\n";
+            return 1;
+        }
+        return ejecutarPruebas(prueba, casos, parametros);
+    }
+    // Compilador --benchmark-profundidad [niveles]: recorridos sobre anidamientos muy profundos
+    if (modo == "--benchmark-profundidad") {
+        size_t niveles = 1000000;
+        if (!leerArgumento(1, niveles)) return 1;
+        return ejecutarBenchmarkProfundidad(niveles);
+    }
+    // Compilador --exportar svg|dot archivo "expresion": arbol de parseo sin abrir ventanas
+    if (modo == "--exportar" && argumentos.size() > 3) {
+        return exportarArbol(argumentos[1], argumentos[2], argumentos[3]);
+    }
+    // Compilador --emitir-c [archivo]: codigo C de cada expresion, una funcion por linea valida
+    if (modo == "--emitir-c") {
+        return emitirC(argumentos.size() > 1 ? argumentos[1] : "");
+    }
+#if USAR_NATIVO
+    // Compilador --benchmark-nativo [archivo]: maquina virtual contra codigo nativo cargado con dlopen
+    if (modo == "--benchmark-nativo") {
+        return compararNativo(argumentos.size() > 1 ? argumentos[1] : "");
+    }
+#endif
+    // Compilador --guardar archivo.bin [expresiones] [--secciones literales,arbol]: programas compilados en binario
+    if (modo == "--guardar" && argumentos.size() > 1) {
+        static const pair<string_view, uint32_t> nombres[] = { { "literales", SECCION_LITERALES }, { "arbol", SECCION_ARBOL } };
+        string entrada;
+        uint32_t secciones = 0;
+        for (size_t i = 2; i < argumentos.size(); i++) {
+            if (argumentos[i] != "--secciones") entrada = argumentos[i];
+            else if (i + 1 >= argumentos.size() || !leerBanderas(argumentos[++i], nombres, secciones)) {
+                cerr << "Secciones no validas, use literales y arbol separadas por comas\n";
+                return 1;
+            }
+        }
+        return guardarBinario(argumentos[1], entrada, secciones);
+    }
+    // Compilador --cargar archivo.bin: evalua los programas guardados sin volver a compilarlos
+    if (modo == "--cargar" && argumentos.size() > 1) {
+        return cargarBinario(argumentos[1]);
+    }
+    // Compilador --ver-binario archivo.bin [indice]: arbol de parseo guardado con --secciones arbol
+    if (modo == "--ver-binario" && argumentos.size() > 1) {
+        size_t indice = 0;
+        if (!leerArgumento(2, indice)) return 1;
+        return verArbolBinario(argc, argv, argumentos[1], indice);
+    }
+    // Compilador --comparar-arboles [terminos]: memoria y recorrido de las dos representaciones del arbol
+    if (modo == "--comparar-arboles") {
+        size_t terminos = 20000;
+        if (!leerArgumento(1, terminos)) return 1;
+        return compararArboles(terminos);
     }
-    cout << "\n\n";
 
-    encontrarAmbiguedad();
-    parser(); // Analizar y construir el árbol
-    generarLenguaje();
+    cout << "Ingrese la cadena: ";
+    getline(cin, contexto.almacen);
+    contexto.entrada = contexto.almacen;
+
+    bool correcta = compilar(contexto);
+    salidaEstandar.vaciar();
+    if (!correcta) {
+        return 0;
+    }
 
     // Imprimir o no el arbol de parseo, si es que todo salio bien
     cout << "Ver el arbol de parseo? (S)(N) ";
@@ -635,10 +6147,11 @@ int main(int argc, char** argv) {
     switch (respuesta) {
     case 'S':
     case 's':
+        asegurarArbol(contexto);
         verArbol(argc, argv);
         break;
     case 'N':
     case 'n':
         return 0;
     } 
-}
\ No newline at end of file
+}
\ No newline at end of file